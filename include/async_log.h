@@ -0,0 +1,76 @@
+/*© 2023. Triad National Security, LLC. All rights reserved.
+This program was produced under U.S. Government contract 89233218CNA000001 for Los Alamos
+National Laboratory (LANL), which is operated by Triad National Security, LLC for the U.S.
+Department of Energy/National Nuclear Security Administration. All rights in the program are.
+reserved by Triad National Security, LLC, and the U.S. Department of Energy/National Nuclear
+Security Administration. The Government is granted for itself and others acting on its behalf a
+nonexclusive, paid-up, irrevocable worldwide license in this material to reproduce, prepare.
+derivative works, distribute copies to the public, perform publicly and display publicly, and to permit.
+others to do so.*/
+
+#pragma once
+
+#include <plog/Log.h>
+
+#include <condition_variable>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// debug and verbose records are compiled out unless the build enables
+// NUDUSTC_DEBUG_LOG, so they cost nothing inside the integration loop
+#ifndef NUDUSTC_DEBUG_LOG
+#undef PLOGD
+#undef PLOGV
+#define PLOGD if (true) {;} else PLOG(plog::debug)
+#define PLOGV if (true) {;} else PLOG(plog::verbose)
+#endif
+
+// plog appender that keeps the file off the calling threads. each thread
+// formats its records into its own buffer; a background thread swaps the
+// buffers out and writes them every few hundred milliseconds, or at once
+// for warnings and errors. records of one thread stay in order, records
+// of different threads are only ordered to within a flush interval.
+class async_file_appender : public plog::IAppender
+{
+  struct thread_buffer
+  {
+    std::mutex  lock;
+    std::string text;
+  };
+
+  std::ofstream out;
+
+  std::mutex                                  registry_lock;
+  std::vector<std::shared_ptr<thread_buffer>> buffers;
+
+  std::mutex              wake_lock;
+  std::condition_variable wake;
+  bool                    urgent   = false;
+  bool                    stopping = false;
+  std::thread             writer;
+
+  thread_buffer& local_buffer();
+  void drain();
+  void writer_loop();
+
+public:
+  explicit async_file_appender(const std::string& filename);
+  ~async_file_appender();
+
+  async_file_appender(const async_file_appender&) = delete;
+  async_file_appender& operator=(const async_file_appender&) = delete;
+
+  void write(const plog::Record& record) override;
+};
+
+// log file of one rank: log.txt stays log.txt for a single rank and
+// becomes log_r<rank>.txt otherwise
+std::string rank_log_name(const std::string& filename, int rank, int size);
+
+// route the default plog instance through an async_file_appender that
+// lives until exit, so records logged just before exit(1) are written
+void init_async_log(const std::string& filename, plog::Severity severity);
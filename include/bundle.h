@@ -0,0 +1,127 @@
+/*© 2023. Triad National Security, LLC. All rights reserved.
+This program was produced under U.S. Government contract 89233218CNA000001 for Los Alamos
+National Laboratory (LANL), which is operated by Triad National Security, LLC for the U.S.
+Department of Energy/National Nuclear Security Administration. All rights in the program are.
+reserved by Triad National Security, LLC, and the U.S. Department of Energy/National Nuclear
+Security Administration. The Government is granted for itself and others acting on its behalf a
+nonexclusive, paid-up, irrevocable worldwide license in this material to reproduce, prepare.
+derivative works, distribute copies to the public, perform publicly and display publicly, and to permit.
+others to do so.*/
+
+#pragma once
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+struct cell_input;
+
+const uint32_t BUNDLE_VERSION = 1;
+
+// per cell columns stored in a bundle
+enum bundle_column
+{
+  BCOL_INIT_ABUND = 0,
+  BCOL_SIZE_DIST,
+  BCOL_VD,
+  BCOL_TIMES,
+  BCOL_TEMP,
+  BCOL_VOLUMES,
+  BCOL_RHO,
+  BCOL_PRESSURE,
+  BCOL_VELO,
+  BCOL_X_CM,
+  BCOL_N_COLUMNS
+};
+
+enum bundle_flags : uint32_t
+{
+  BUNDLE_HAS_SIZE_DIST = 1,
+  BUNDLE_HAS_ENV       = 2,
+  BUNDLE_HAS_SHOCK     = 4
+};
+
+// file layout, all offsets in bytes from the start of the file and
+// 8 byte aligned:
+//   bundle_header
+//   element names, '\0' separated
+//   size bins [n_bins], bin edges [n_bins + 1]
+//   bundle_cell [n_cells], ascending cid
+//   column data (doubles)
+struct bundle_header
+{
+  char     magic[8];
+  uint32_t version;
+  uint32_t flags;
+  uint32_t n_cells;
+  uint32_t n_elements;
+  uint32_t n_grains;
+  uint32_t n_bins;
+  uint64_t names_offset;
+  uint64_t names_bytes;
+  uint64_t bins_offset;
+  uint64_t cells_offset;
+};
+
+struct bundle_cell
+{
+  uint32_t cid;
+  uint32_t pad;
+  double   cell_time;
+  double   shock_time;
+  double   shock_temp;
+  uint64_t offset[BCOL_N_COLUMNS];
+  uint64_t length[BCOL_N_COLUMNS];
+};
+
+// read only view of doubles inside the mapped bundle
+struct double_span
+{
+  const double* ptr = nullptr;
+  size_t len        = 0;
+
+  const double* begin() const { return ptr; }
+  const double* end() const { return ptr + len; }
+  size_t size() const { return len; }
+  const double& operator[](size_t i) const { return ptr[i]; }
+};
+
+// memory mapped, columnar copy of a run's abundance, size distribution,
+// environment and shock inputs. written by `nudustc++ --pack`
+struct input_bundle
+{
+  boost::interprocess::file_mapping  file;
+  boost::interprocess::mapped_region region;
+  const char* data = nullptr;
+  size_t size      = 0;
+
+  const bundle_header* header = nullptr;
+  const bundle_cell*   cells  = nullptr;
+
+  bool open(const std::string& filename);
+
+  std::vector<std::string> element_names() const;
+  double_span size_bins() const;
+  double_span bin_edges() const;
+  std::vector<uint32_t> cell_ids() const;
+  const bundle_cell* find(uint32_t cid) const;
+  double_span column(const bundle_cell& c, bundle_column col) const;
+
+  void load_cells(const std::vector<uint32_t>& cids, std::map<uint32_t, cell_input>& inputs, bool with_env = true) const;
+  void load_env(uint32_t cid, cell_input& input) const;
+
+  static void write(const std::string& filename,
+                    uint32_t flags,
+                    const std::vector<std::string>& elements,
+                    uint32_t n_grains,
+                    const std::vector<double>& size_bins,
+                    const std::vector<double>& bin_edges,
+                    const std::map<uint32_t, cell_input>& inputs);
+
+private:
+  bool check_layout(const std::string& filename) const;
+};
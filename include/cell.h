@@ -11,13 +11,15 @@ others to do so.*/
 #pragma once
 
 #include "configuration.h"
-#include "elements.h"
 #include "network.h"
 #include "sput_params.h"
 #include "sputter.h"
 #include "utilities.h"
 #include "constants.h"
+#include "env_interpolator.h"
+#include "scheduler.h"
 
+#include <cmath>
 #include <vector>
 #include <string>
 #include <map>
@@ -77,6 +79,11 @@ struct cell_input
   double sim_start_time; // this is from the config file
   double inp_cell_time; // this is read in from the size dist file
 
+  // set when the cell continues from its restart file: the restart time
+  // and how much of the output belongs before it
+  double   resume_time = NAN;
+  uint64_t resume_output_mark = 0;
+
   // for destruction calculate shock values from enviornment file
   std::vector<double> inp_shock_times_arr;
   std::vector<double> inp_shock_velo_arr;
@@ -137,6 +144,8 @@ struct cell_state
   std::vector<double> grn_sizes;
   std::vector<double> edges;
   double start_time;
+  double resume_time = NAN;
+  uint64_t resume_mark = 0;
   double time;
   double dt;
 
@@ -154,6 +163,37 @@ struct cell_state
   std::vector<double> rebin_chng;
 };
 
+// maps a cell's reduced state onto the full network layout
+// [gas | N_MOMENTS x grains | grains x bins | (anything else)]
+// grains that can never nucleate and start empty are dropped from the
+// integrated state and only restored when writing output
+struct cell_layout
+{
+  size_t numGas;
+  size_t numBins;
+  size_t full_numReact;
+
+  // local grain index -> network nucleation index
+  std::vector<size_t> grn_map;
+  // reduced state index -> full state index
+  std::vector<size_t> state_map;
+
+  // entries of a full layout array that are not integrated: their index
+  // in the full array and the value they keep for the whole run
+  struct dropped
+  {
+    size_t              full_size = 0;
+    std::vector<size_t> idx;
+    std::vector<double> vals;
+  };
+  dropped dropped_state;
+  dropped dropped_vd;
+  dropped dropped_delSZ;
+
+  void expand_state(const std::vector<double>& x, std::vector<double>& full) const;
+  void expand_bins(const std::vector<double>& v, const dropped& d, std::vector<double>& full) const;
+};
+
 class cell
 {
 public:
@@ -161,57 +201,63 @@ public:
   params*         sputARR;
   configuration*  config;
   uint32_t        cid;
-  xkin::element_list_t elm;
-  std::vector<cell_state> solution_states;
-  std::vector<double> init_SD;
-  std::vector<bool> reaction_switch;
-
-  std::vector<double> env_times;
-  std::vector<double> env_temp;
-  std::vector<double> env_volumes;
-  std::vector<double> env_rho;
-  std::vector<double> env_pressure;
-
-  std::vector<double> env_shock_times;
-  std::vector<double> env_shock_velo;
-  std::vector<double> env_shock_bool;
-
-  // define interpolator. probably not the best method but it works.
-  std::vector<double> fake1{ 1, 2, 3, 4 }, fake2{ 1, 4, 8, 16 };
-  boost::math::interpolators::makima<std::vector<double>> env_temp_interp = makima(std::move(fake1), std::move(fake2));
-  std::vector<double> fake3{ 1, 5, 9, 12 }, fake4{ 1, 4, 8, 16 };
-  boost::math::interpolators::makima<std::vector<double>> env_volume_interp =
-    makima(std::move(fake3), std::move(fake4));
-  std::vector<double> fake7{ 1, 2, 3, 4 }, fake8{ 1, 4, 8, 16 };
-  boost::math::interpolators::makima<std::vector<double>> env_rho_interp =
-    makima(std::move(fake7), std::move(fake8));
-  std::vector<double> fake11{ 1, 2, 3, 4 }, fake12{ 1, 4, 8, 16 };
-  boost::math::interpolators::makima<std::vector<double>> env_pressure_interp =
-    makima(std::move(fake11), std::move(fake12));
-  std::vector<double> fake13{ 1, 2, 3, 4 }, fake14{ 0, 1, 1, 0 };
-  boost::math::interpolators::makima<std::vector<double>> env_shock_bool_interp =
-    makima(std::move(fake13), std::move(fake14));
-  std::vector<double> fake15{ 1, 2, 3, 4 }, fake16{ 0, 1, 1, 0 };
-  boost::math::interpolators::makima<std::vector<double>> env_shock_velo_interp =
-    makima(std::move(fake15), std::move(fake16));
+  std::vector<uint8_t> reaction_switch;
+
+  // reachable part of the network for this cell
+  cell_layout layout;
+  std::vector<size_t> chem_reactions;
+  std::vector<int> dvdt_idx;
+
+  // reactions whose switch is on, rebuilt by check_reactions when the
+  // switch pattern changes. nucleation entries are local grain indices,
+  // chemical entries are reaction indices
+  std::vector<size_t> active_nucleation;
+  std::vector<size_t> active_chemical;
+
+  // temperature, volume, density and pressure over time, taken over from
+  // the cell input. the interpolator is only built when solve() starts
+  std::shared_ptr<const env_series> env;
+  env_interpolator env_interp;
 
   cell_state cell_st;
 
   bool integration_abandoned;
 
+  void reduce_network();
   void check_reactions(const std::vector<double>& x);
+  void update_active_reactions();
   bool check_solution(const std::vector<double>& x);
   void rebin (const std::vector<double>& x, std::vector<double>& dxdt);
+  void rebin_grain(const std::vector<double>& x, std::vector<double>& dxdt, size_t gidx);
   void calc_state_vars(const std::vector<double>& x, const double time);
+  double volume_at(double time);
   void nucleate(const std::vector<double>& x);
+  void nucleate_grain(const std::vector<double>& x, size_t gidx);
   void destroy();
+  void destroy_grain(size_t gidx);
   void add_new_grn(const std::vector<double>& x);
   double calc_dvdt(const double& cross_sec, const double& vd, const int grnid);
   double Y(const double& E, const int grnid, const int gasid);
   double Therm(const int grnid, const int gasid);
-  double NonTherm(const double& sidx, const int grnid, const int gsID);
-  void set_init_data(const spec_v& init_s, const cell_input& init_data);
-  void set_env_data(const cell_input& input_data);
+  double NonTherm(const int iid, const int grnid, const int gsID);
+  void set_init_data(const spec_v& init_s, cell_input& init_data);
+  void set_env_data(cell_input& input_data);
+  bool has_env_spline() const { return env && env->times.size() != 1; }
+
+  // run f(gidx) for every grain species. with intra_cell_parallel the
+  // grains are shared with idle threads of the cell scheduler, otherwise
+  // they run in order on the calling thread
+  template<typename F>
+  void for_each_grain(F&& f)
+  {
+    size_t n = cell_st.numReact;
+    if (config->intra_cell_parallel == 1)
+    {
+      work_pool::parallel_for(n, f);
+      return;
+    }
+    for (size_t gidx = 0; gidx < n; ++gidx) f(gidx);
+  }
 
 public:
   cell(network* n,
@@ -219,9 +265,16 @@ public:
        configuration* con,
        uint32_t id,
        const spec_v& init_s,
-       const cell_input& input_data);
+       cell_input&& input_data);
+
+  // cells own large buffers and are only ever moved
+  cell(cell&&) = default;
+  cell& operator=(cell&&) = default;
+  cell(const cell&) = delete;
+  cell& operator=(const cell&) = delete;
 
   virtual ~cell(){};
+  size_t memory_bytes() const;
   void solve();
   void operator()(const std::vector<double>& x, std::vector<double>& dxdt, const double t);
 
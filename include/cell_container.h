@@ -0,0 +1,115 @@
+/*© 2023. Triad National Security, LLC. All rights reserved.
+This program was produced under U.S. Government contract 89233218CNA000001 for Los Alamos
+National Laboratory (LANL), which is operated by Triad National Security, LLC for the U.S.
+Department of Energy/National Nuclear Security Administration. All rights in the program are.
+reserved by Triad National Security, LLC, and the U.S. Department of Energy/National Nuclear
+Security Administration. The Government is granted for itself and others acting on its behalf a
+nonexclusive, paid-up, irrevocable worldwide license in this material to reproduce, prepare.
+derivative works, distribute copies to the public, perform publicly and display publicly, and to permit.
+others to do so.*/
+
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// one append-only file per rank that holds the output stream and restart
+// file of each of its cells, so a run makes one file per rank instead of
+// two per cell and startup needs no per-cell file lookups.
+//
+// the file starts with
+//   char[4] "NUDC", uint32 version, byte order probe 0x01020304
+//   uint32 length + output file stem, uint32 length + output extension
+// followed by records
+//   char[4] "NUDc", uint32 kind, uint32 cell id, uint32 0, uint64 length, payload
+// a cell's output is the concatenation of its output records, cut back to
+// the length of its last truncate record where there is one. the last
+// restart record of an unfinished cell is its restart file.
+//
+// a closed container ends with an index
+//   per cell: uint32 id, uint32 finished, uint64 restart offset, uint64
+//             restart length, uint64 chunk count, (uint64 offset, uint64
+//             length) per output chunk
+//   char[4] "NUDI", uint32 0, uint64 index offset, uint64 cell count,
+//   uint64 FNV-1a of the index
+// a container without one (the run was killed) is rebuilt by scanning the
+// records, dropping a torn last record. records of different cells are
+// written concurrently, so one cut short by the kill also drops the
+// records behind it; what is left is still a consistent earlier state.
+// new records are written over the old index and a new index is written
+// on close. a container that is mostly superseded restart records is
+// compacted on close.
+class cell_container
+{
+public:
+  enum record_kind : uint32_t { output = 1, truncate = 2, restart = 3, finished = 4 };
+
+private:
+  struct chunk
+  {
+    uint64_t offset, length;
+  };
+  struct cell_entry
+  {
+    std::vector<chunk> chunks;
+    uint64_t output_length  = 0;
+    uint64_t restart_offset = 0;
+    uint64_t restart_length = 0;
+    bool     finished       = false;
+  };
+
+  std::string filename;
+  int         fd       = -1;
+  bool        writable = false;
+  uint64_t    end      = 0; // where the next record goes
+  uint64_t    header_bytes  = 0;
+  bool        sync_restarts = true;
+  std::mutex  lock;
+  std::map<uint32_t, cell_entry> cells;
+
+  bool read_header();
+  bool read_index();
+  void scan_records(uint64_t from);
+  void apply(uint32_t kind, uint32_t cid, uint64_t offset, uint64_t length, uint64_t value);
+  void append(uint32_t kind, uint32_t cid, const char* payload, uint64_t length, uint64_t value);
+  void write_index();
+  bool compact();
+  bool read_at(uint64_t offset, char* p, uint64_t n) const;
+
+public:
+  static cell_container* active; // container the observers of this rank write to
+
+  // file name pieces of the per-cell output files, for extraction
+  std::string output_stem;
+  std::string output_ext;
+
+  // opens an existing container or, if writable, creates one. exits on
+  // errors, like the other output files
+  cell_container(const std::string& filename, bool writable, const std::string& stem = "",
+                 const std::string& ext = "");
+  ~cell_container(); // writes the index
+
+  cell_container(const cell_container&) = delete;
+  cell_container& operator=(const cell_container&) = delete;
+
+  void append_output(uint32_t cid, const char* data, uint64_t n);
+  void truncate_output(uint32_t cid, uint64_t length);
+  // the restart record is synced to disk with all output before it
+  void put_restart(uint32_t cid, const std::string& contents);
+  void finish_cell(uint32_t cid);
+
+  bool     cell_finished(uint32_t cid);
+  bool     has_restart(uint32_t cid);
+  uint64_t output_length(uint32_t cid);
+  bool     read_restart(uint32_t cid, std::string& contents);
+  bool     read_output(uint32_t cid, std::string& contents);
+  std::vector<uint32_t> cell_ids();
+};
+
+// write the output of the given cells (all if empty) of a container to
+// <stem><cell><ext> files next to it. false if a cell cannot be written
+bool extract_container(const std::string& filename, const std::vector<uint32_t>& cids);
@@ -11,9 +11,18 @@ perform publicly and display publicly, and to permit. others to do so.*/
 
 #pragma once
 
-// #include "H5Cpp.h"
 #include "cell.h"
+#include "cell_container.h"
+#include "h5_output.h"
+#include "io_thread.h"
+#include "output_codec.h"
+#include "reductions.h"
 
+#include <condition_variable>
+#include <chrono>
+#include <fstream>
+#include <mutex>
+#include <string>
 #include <vector>
 
 class CellObserver {
@@ -29,23 +38,112 @@ class CellObserver {
   std::string grnNames = "";
 
 private:
-  cell_state m_state;
-  double m_time;
-  double m_elapsed;
+  const cell_layout* layout;
+  enum class output_kind { text, binary, compressed, hdf5 } kind;
+#ifdef NUDUSTC_ENABLE_HDF5
+  std::unique_ptr<h5_cell_writer> h5;
+#endif
+
+  // full layout values of the last state handed in. only filled when the
+  // cell integrates a reduced network, otherwise the state is written as is
+  std::vector<double> full_x;
+  std::vector<double> full_vd;
+  std::vector<double> full_delSZ;
+
+  // with async_io, snapshots are copied into one of two buffers and
+  // written by the io thread while the other one is filled
+  struct snapshot
+  {
+    double time;
+    std::vector<double> x, vd, delSZ;
+    bool busy = false;
+  };
+  io_thread*              io = nullptr;
+  snapshot                slots[2];
+  int                     next_slot = 0;
+  std::mutex              slot_lock;
+  std::condition_variable slot_free;
+
+  snapshot& take_slot();
+  void release_slot(snapshot& snap);
+  void wait_written();
 
   uint32_t m_nrestart, m_ndump;
   uint32_t n_called;
+  // restart_wall_interval, and when the last restart file was written
+  std::chrono::duration<double> wall_interval;
+  std::chrono::steady_clock::time_point last_restart;
 
+  // kept open for the life of the cell with a large buffer of its own
+  std::vector<char> ofs_buf;
   std::ofstream ofs;
-  std::ofstream oRS;
-  std::string hfname;
+  uint64_t      net_hash;
+  std::string   rs_buf; // restart file contents, reused
+
+  const std::vector<double>& full_solution(const std::vector<double>& x, std::vector<double>& scratch) const;
+  void write_record(double time, const std::vector<double>& x);
+  void write_restart(double time, const std::vector<double>& x, const std::vector<double>& vd,
+                     const std::vector<double>& delSZ);
+  void write_text(const std::vector<double>& vals, const char* fmt);
+  void write_raw(const void* p, size_t bytes) { put(static_cast<const char*>(p), bytes); }
+
+  // with output_container the output goes to this rank's container in
+  // chunks of about the file buffer size instead of to ofs
+  cell_container* container = nullptr;
+  std::string     chunk;
+  void put(const char* p, size_t n);
+  void flush_chunk();
+  void open_output(std::ios::openmode mode);
+
+  // cell_output = 0 leaves out the dumps; restart files are still written,
+  // and a finished cell leaves an empty done_name file (the container
+  // records the finish itself) so the next run skips it
+  bool write_output = true;
+  std::string done_name;
+
+  // in-situ reductions: the next grid time to sample and the values of
+  // the cell there
+  const network*            net;
+  cell_reductions*          reducer = nullptr;
+  size_t                    next_sample = 0;
+  bool                      resumed = false; // not sampled before its restart point
+  bool                      has_volume;
+  cell_reductions::sample   smp;
+  std::vector<double>       sample_full;
+  void compute_sample(const cell_state& s, double volume, const std::vector<double>& x);
+
+  // compressed output: records (time first) waiting to fill a block
+  std::vector<double> pending;
+  size_t pending_rows = 0;
+  size_t block_rows   = 0;
+  void write_block();
 
 public:
-  CellObserver(std::size_t cid, const network *net, configuration *con);
-  virtual ~CellObserver() {}
+  CellObserver(std::size_t cid, const network *net, configuration *con, const cell_layout *layout);
+  virtual ~CellObserver() { if (io) wait_written(); }
   void init_dump(const cell_state &s);
-  void operator()(const cell_state &s);
+  void resume_dump(const cell_state &s, uint64_t mark);
+  // time and state are the integrator's after the accepted step; the
+  // restart file takes them so a restarted cell continues from there
+  void operator()(const cell_state &s, double time, const std::vector<double> &state);
   void dump_data(const cell_state &s);
-  void restart_dump(const cell_state &s);
+  void restart_dump(const cell_state &s, double time, const std::vector<double> &state);
   void finalSave(const cell_state &s);
+  void checkpoint(const cell_state &s, double time, const std::vector<double> &state);
+
+  // the cell samples the reductions at each grid time its steps pass,
+  // from its dense output, and hands its final state to end_samples(),
+  // which also fills the grid times after its end. volume is the cell's
+  // at the time of x
+  double next_sample_time() const;
+  void skip_samples_before(double t);
+  void add_sample(const cell_state &s, double volume, const std::vector<double> &x);
+  void end_samples(const cell_state &s, double volume, const std::vector<double> &x);
 };
+
+// file extension of the cell output files of an output_format
+std::string output_extension(const std::string& format);
+
+// write a binary or compressed observer file in the text layout of
+// output_format = text. returns false if the file cannot be read
+bool export_observer_text(const std::string& bin_file, const std::string& text_file);
@@ -32,16 +32,33 @@ struct configuration
 
   int io_dump_n_steps;
   int io_restart_n_steps;
+  double restart_wall_interval;
   int bin_number;
 
   int do_destruction;
   int do_nucleation;
 
+  int use_network_cache;
+  int parse_threads;
+  int lazy_cells;
+  int n_threads;
+  int intra_cell_parallel;
+  int cell_batch;
+
   std::string network_file;
   std::string sizeDist_file;
   std::string abundance_file;
   std::string shock_file;
   std::string environment_file;
+  std::string input_bundle;
+  std::string cell_distribution;
+  std::string output_format;
+  int async_io;
+  int output_container;
+  int cell_output;
+  int reduce_n_times;
+  double reduce_t_min;
+  double reduce_t_max;
 
   // used to differentiate runs or models
   std::string mod_number;
@@ -78,6 +78,13 @@ struct element_list_t
     }
   }
 
+  // atomic mass in amu, or -1 if symbol is not an element
+  double mass_of(const std::string& symbol) const
+  {
+    auto eitr = elements.find(symbol);
+    return (eitr == elements.end() ? -1.0 : eitr->second.mass);
+  }
+
   int get_element_index(const std::string& en)
   {
     auto eitr = elements.find(en);
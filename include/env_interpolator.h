@@ -0,0 +1,162 @@
+/*© 2023. Triad National Security, LLC. All rights reserved.
+This program was produced under U.S. Government contract 89233218CNA000001 for Los Alamos
+National Laboratory (LANL), which is operated by Triad National Security, LLC for the U.S.
+Department of Energy/National Nuclear Security Administration. All rights in the program are.
+reserved by Triad National Security, LLC, and the U.S. Department of Energy/National Nuclear
+Security Administration. The Government is granted for itself and others acting on its behalf a
+nonexclusive, paid-up, irrevocable worldwide license in this material to reproduce, prepare.
+derivative works, distribute copies to the public, perform publicly and display publicly, and to permit.
+others to do so.*/
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+// channels of the environment (trajectory) data
+enum env_channel
+{
+  ENV_TEMP = 0,
+  ENV_VOLUME,
+  ENV_RHO,
+  ENV_PRESSURE,
+  ENV_N_CHANNELS
+};
+
+// trajectory of one cell: the time axis and one series per channel. it is
+// filled once from the cell's input and then only read, by the cell and
+// its interpolator alike
+struct env_series
+{
+  std::vector<double> times;
+  std::vector<double> values[ENV_N_CHANNELS];
+
+  size_t bytes() const
+  {
+    size_t n = times.capacity();
+    for (const auto& v: values) n += v.capacity();
+    return n * sizeof(double);
+  }
+};
+
+// makima (modified Akima) interpolation of every channel of an env_series.
+// slopes are computed the same way as boost::math::interpolators::makima.
+// one evaluation brackets t once and returns values and derivatives for
+// every channel. the bracket is cached and searched from the last interval
+// first, since the integrator mostly moves forward in small steps.
+class env_interpolator
+{
+  static const size_t nch = ENV_N_CHANNELS;
+
+  std::shared_ptr<const env_series> data;
+  // knot-major: dydx_[i*nch + c]
+  std::vector<double> dydx_;
+  size_t last = 0;
+
+  // find i such that x[i] <= t < x[i+1]
+  size_t bracket(const std::vector<double>& x, double t)
+  {
+    if (t >= x[last] && t < x[last + 1])
+      return last;
+    if (last + 2 < x.size() && t >= x[last + 1] && t < x[last + 2])
+      return ++last;
+    auto it = std::upper_bound(x.begin(), x.end(), t);
+    last    = std::distance(x.begin(), it) - 1;
+    return last;
+  }
+
+  static double makima_slope(double mim2, double mim1, double mi, double mip1)
+  {
+    using std::abs;
+    double w1 = abs(mip1 - mi) + abs(mip1 + mi) / 2;
+    double w2 = abs(mim1 - mim2) + abs(mim1 + mim2) / 2;
+    double s  = (w1 * mim1 + w2 * mi) / (w1 + w2);
+    return std::isnan(s) ? 0.0 : s;
+  }
+
+public:
+  env_interpolator() = default;
+
+  explicit env_interpolator(std::shared_ptr<const env_series> series)
+    : data(std::move(series))
+  {
+    const auto& x_ = data->times;
+    auto n = x_.size();
+    if (n < 4)
+    {
+      throw std::domain_error("Must be at least four data points.");
+    }
+    dydx_.resize(n * nch);
+    for (size_t c = 0; c < nch; ++c)
+    {
+      const auto& y = data->values[c];
+      auto m = [&](size_t i) { return (y[i + 1] - y[i]) / (x_[i + 1] - x_[i]); };
+
+      // quadratic extrapolation of the secants past either end
+      double m0 = m(0), m1 = m(1), m2 = m(2);
+      double mm1 = 2 * m0 - m1;
+      double mm2 = 2 * mm1 - m0;
+      dydx_[c]       = makima_slope(mm2, mm1, m0, m1);
+      dydx_[nch + c] = makima_slope(mm1, m0, m1, m2);
+      for (size_t i = 2; i < n - 2; ++i)
+        dydx_[i * nch + c] = makima_slope(m(i - 2), m(i - 1), m(i), m(i + 1));
+      double mnm4 = m(n - 4), mnm3 = m(n - 3), mnm2 = m(n - 2);
+      double mnm1 = 2 * mnm2 - mnm3;
+      double mn   = 2 * mnm1 - mnm2;
+      dydx_[(n - 2) * nch + c] = makima_slope(mnm4, mnm3, mnm2, mnm1);
+      dydx_[(n - 1) * nch + c] = makima_slope(mnm3, mnm2, mnm1, mn);
+    }
+  }
+
+  bool empty() const { return !data; }
+  size_t size() const { return data ? data->times.size() : 0; }
+  size_t bytes() const { return dydx_.capacity() * sizeof(double); }
+
+  // values and time derivatives of all channels at t
+  void operator()(double t, double* vals, double* derivs)
+  {
+    const auto& x_ = data->times;
+    if (t < x_[0] || t > x_.back())
+    {
+      std::ostringstream oss;
+      oss.precision(18);
+      oss << "Requested abscissa x = " << t << ", which is outside of allowed range [" << x_[0] << ", "
+          << x_.back() << "]";
+      throw std::domain_error(oss.str());
+    }
+    if (t == x_.back())
+    {
+      auto k = x_.size() - 1;
+      for (size_t c = 0; c < nch; ++c)
+      {
+        vals[c]   = data->values[c][k];
+        derivs[c] = dydx_[k * nch + c];
+      }
+      return;
+    }
+    auto i     = bracket(x_, t);
+    double x0  = x_[i];
+    double dx  = x_[i + 1] - x0;
+    double tt  = (t - x0) / dx;
+    double tx  = t - x0;
+    const double* s0 = &dydx_[i * nch];
+    const double* s1 = s0 + nch;
+    for (size_t c = 0; c < nch; ++c)
+    {
+      double y0 = data->values[c][i];
+      double y1 = data->values[c][i + 1];
+      // cubic hermite value and derivative on [x0, x1]
+      vals[c] = (1 - tt) * (1 - tt) * (y0 * (1 + 2 * tt) + s0[c] * tx) +
+                tt * tt * (y1 * (3 - 2 * tt) + dx * s1[c] * (tt - 1));
+      double d1 = (y1 - y0 - s0[c] * dx) / (dx * dx);
+      double d2 = (s1[c] - s0[c]) / (2 * dx);
+      double c2 = 3 * d1 - 2 * d2;
+      double c3 = 2 * (d2 - d1) / dx;
+      derivs[c] = s0[c] + 2 * c2 * tx + 3 * c3 * tx * tx;
+    }
+  }
+};
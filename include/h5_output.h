@@ -0,0 +1,105 @@
+/*© 2023. Triad National Security, LLC. All rights reserved.
+This program was produced under U.S. Government contract 89233218CNA000001 for Los Alamos
+National Laboratory (LANL), which is operated by Triad National Security, LLC for the U.S.
+Department of Energy/National Nuclear Security Administration. All rights in the program are.
+reserved by Triad National Security, LLC, and the U.S. Department of Energy/National Nuclear
+Security Administration. The Government is granted for itself and others acting on its behalf a
+nonexclusive, paid-up, irrevocable worldwide license in this material to reproduce, prepare.
+derivative works, distribute copies to the public, perform publicly and display publicly, and to permit.
+others to do so.*/
+
+#pragma once
+
+#ifdef NUDUSTC_ENABLE_HDF5
+
+#include <H5Cpp.h>
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// output_format = hdf5: one file per rank, output/B<bins>_<net>_r<rank>.h5,
+// with a group per cell:
+//   cell_<cid>/grain_sizes    sizes of the bins
+//   cell_<cid>/initial_state  initial values in the full network layout
+//   cell_<cid>/time           (n)            one entry per dump
+//   cell_<cid>/gas            (n x gas)      abundances
+//   cell_<cid>/moments        (n x N_MOMENTS*grains)
+//   cell_<cid>/size_bins      (n x grains*bins)
+//   cell_<cid>/extra          (n x rest)     rest of the state, if any
+// the datasets are chunked and grow as records are appended. the group
+// gets a "finished" attribute once the cell is done, and unfinished
+// groups are replaced when the cell is run again.
+//
+// the HDF5 library is not thread safe, so every call goes through one
+// lock. records are buffered per cell and written a chunk at a time.
+class h5_rank_file
+{
+  H5::H5File file;
+
+public:
+  static std::mutex    lock;
+  static h5_rank_file* active; // file the observers of this rank write to
+
+  // opens the file if it exists, so finished cells can be skipped. a file
+  // left unreadable by a killed run is moved to <filename>.bad
+  explicit h5_rank_file(const std::string& filename);
+  ~h5_rank_file();
+
+  h5_rank_file(const h5_rank_file&) = delete;
+  h5_rank_file& operator=(const h5_rank_file&) = delete;
+
+  bool cell_finished(uint32_t cid);
+  // records in the cell's group, 0 if it has none
+  size_t cell_rows(uint32_t cid);
+
+  friend class h5_cell_writer;
+};
+
+class h5_cell_writer
+{
+  struct column_set
+  {
+    size_t      offset;
+    size_t      width;
+    H5::DataSet ds;
+  };
+
+  H5::Group               group;
+  H5::DataSet             time_ds;
+  std::vector<column_set> sets;
+  size_t n_values;
+  size_t chunk_rows;
+  size_t rows_written = 0;
+
+  // records not yet written
+  std::vector<double> times;
+  std::vector<double> rows;
+
+  void write_rows();
+  bool reopen(size_t n);
+
+public:
+  // sections: the widths of gas, moments and size bins; the rest of a
+  // row of n_values goes to "extra". with resume_rows, an unfinished
+  // group of the cell is kept and cut back to that many records
+  h5_cell_writer(h5_rank_file& out, uint32_t cid, const std::string& grain_names,
+                 const std::vector<double>& grain_sizes, const std::vector<double>& initial,
+                 const size_t (&sections)[3], size_t resume_rows = 0);
+  ~h5_cell_writer();
+
+  h5_cell_writer(const h5_cell_writer&) = delete;
+  h5_cell_writer& operator=(const h5_cell_writer&) = delete;
+
+  size_t n_rows() const { return rows_written; }
+  void append(double time, const std::vector<double>& x);
+  void flush();
+  // flush and have the library write the file's caches to disk, so a run
+  // killed later still finds the records up to here
+  void sync();
+  void finish();
+};
+
+#endif
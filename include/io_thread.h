@@ -0,0 +1,45 @@
+/*© 2023. Triad National Security, LLC. All rights reserved.
+This program was produced under U.S. Government contract 89233218CNA000001 for Los Alamos
+National Laboratory (LANL), which is operated by Triad National Security, LLC for the U.S.
+Department of Energy/National Nuclear Security Administration. All rights in the program are.
+reserved by Triad National Security, LLC, and the U.S. Department of Energy/National Nuclear
+Security Administration. The Government is granted for itself and others acting on its behalf a
+nonexclusive, paid-up, irrevocable worldwide license in this material to reproduce, prepare.
+derivative works, distribute copies to the public, perform publicly and display publicly, and to permit.
+others to do so.*/
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+// a thread that runs the file writes queued by the cell observers, so
+// integration goes on while a snapshot is written. jobs run one at a time
+// in the order they were pushed; push() blocks while the queue is full,
+// which holds the integrating threads back when the disk cannot keep up.
+class io_thread
+{
+  std::mutex                        lock;
+  std::condition_variable           not_empty;
+  std::condition_variable           not_full;
+  std::deque<std::function<void()>> jobs;
+  size_t                            capacity;
+  bool                              stopping = false;
+  std::thread                       worker;
+
+  void loop();
+
+public:
+  static io_thread* active; // thread the observers of this process queue to
+
+  explicit io_thread(size_t capacity);
+  ~io_thread(); // runs what is still queued
+
+  io_thread(const io_thread&) = delete;
+  io_thread& operator=(const io_thread&) = delete;
+
+  void push(std::function<void()> job);
+};
@@ -13,8 +13,10 @@ others to do so.*/
 #include "reaction.h"
 
 //#define BOOST_SPIRIT_DEBUG
+#include <cstdint>
 #include <map>
 #include <string>
+#include <unordered_map>
 #include <vector>
 #define _USE_MATH_DEFINES
 #include <boost/fusion/adapted.hpp>
@@ -30,6 +32,9 @@ namespace phx = boost::phoenix;
 
 typedef std::vector<reaction> reaction_v;
 
+// bump when the layout of the compiled network cache changes
+const uint32_t NETWORK_CACHE_VERSION = 2;
+
 BOOST_FUSION_ADAPT_STRUCT(
   reaction,
   (spec_v, reacts)(spec_v, prods)(spec_v, ks_list)(double, alpha)(double, beta)(
@@ -72,6 +77,10 @@ struct network_parser : qi::grammar<Iterator, reaction_v(), Skipper>
 // typedef bicubic_interpolator interpolator;
 
 
+namespace xkin {
+struct element_list_t;
+}
+
 struct network
 {
   std::vector<reaction> reactions;
@@ -86,6 +95,7 @@ struct network
 
   // std::map<int, interpolator> nucl_rate_data;
   std::string network_label;
+  uint64_t source_hash = 0; // hash of the network file
   size_t n_species = 0;
   size_t n_reactions = 0;
   size_t n_nucleation_reactions;
@@ -94,12 +104,25 @@ struct network
   // sms added this here, may move
   std::vector<std::string> grn_names;
 
+  // species holds index -> name in canonical order (see get_species_list),
+  // species_lookup the inverse. species [0, n_gas_species) are gases,
+  // followed by n_nucleation_species condensates, then everything else.
+  std::unordered_map<std::string, size_t> species_lookup;
+  size_t n_gas_species = 0;
+  size_t n_nucleation_species = 0;
+
+  // atomic mass (amu) of each species, -1 for species that are not elements
+  std::vector<double> species_mass;
 
   void get_species_list();
+  void build_species_lookup();
   void map_species_to_reactions();
   int get_species_index(const std::string& spec) const;
-  void read_network(const std::string& chemfile);
+  void read_network(const std::string& chemfile, bool use_cache = false);
+  bool read_cache(const std::string& cachefile, uint64_t src_hash);
+  void write_cache(const std::string& cachefile, uint64_t src_hash) const;
   void post_process();
+  void set_species_masses(const xkin::element_list_t& elements);
   network();
   virtual ~network();
 };
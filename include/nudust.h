@@ -15,6 +15,10 @@ others to do so.*/
 #include "cell.h"
 #include "sputter.h"
 #include "sput_params.h"
+#include "trajectory.h"
+#include "bundle.h"
+#include "h5_output.h"
+#include "cell_container.h"
 
 #include <vector>
 #include <map>
@@ -27,7 +31,17 @@ class nuDust
   sput::sputter_list_t            sputter;
   std::vector<std::string>        initial_elements;
   std::map<uint32_t, cell_input>  cell_inputs;
+  std::vector<uint32_t>           rank_cell_ids; // cells run by this rank, ascending
+  trajectory_index                env_index;
+  input_bundle                    bundle;
   std::vector<cell>               cells;
+  std::vector<uint32_t>           lazy_cell_ids; // cells built just before they are solved
+  // dynamic mode: cells resuming from this rank's own container or hdf5
+  // file, run here instead of from the shared counter
+  std::vector<uint32_t>           pinned_cell_ids;
+  bool                            lazy_cells = false;
+  bool                            dynamic_cells = false; // ranks take cells from a shared counter
+  std::map<uint32_t, double>      cell_costs;    // expected relative run time of each cell to run
   std::vector<cell>             RScells;
   std::map<uint32_t, cell_input> RScell_input;
   network               net;
@@ -39,32 +53,47 @@ class nuDust
   
   std::string name;
   std::string nameRS;
+#ifdef NUDUSTC_ENABLE_HDF5
+  std::unique_ptr<h5_rank_file> h5_out; // this rank's output file
+#endif
+  std::unique_ptr<cell_container> container; // with output_container
 
   int par_size, par_rank;
   int numBins;
 
 public:
   configuration nu_config;
-  nuDust(const std::string& config_filename, int sz, int rk);
+  nuDust(const std::string& config_filename, int sz, int rk, const std::string& pack_file = "");
   nuDust(const std::string& config_filename);
   virtual ~nuDust() {}
 
   void load_network();
+  std::vector<uint32_t> scan_cell_ids();
   void load_initial_abundances();
   void load_sizeDist();
   void load_shock_params();
   void load_sputter_params();
   void find_shock();
+  void decompose_cells(const std::vector<uint32_t>& all_cell_ids);
+  void load_bundle();
+  void write_bundle(const std::string& pack_file);
   void load_environment_data();
   void load_outputFL_names();
   void gen_size_dist();
   void account_for_pileUp();
   void gen_shock_array_frm_val();
-  void create_restart_cells(int cid);
+  bool output_exists(uint32_t cid);
+  bool restart_exists(uint32_t cid);
+  std::vector<uint8_t> shared_cell_flags();
+  bool create_restart_cells(int cid);
   void generate_sol_vector();
   void create_simulation_cells();
   int get_element_index(const std::string& elem) const;
   void premake(const int s1, const int s2, const int sp, const int cell_id);
+  void run_lazy_cell(uint32_t cid);
+  double estimate_cost(uint32_t cid, const cell_input& input) const;
+  void apply_recorded_timings();
+  void write_cell_timings(const std::map<uint32_t, double>& seconds) const;
   void run();
   void cleanup() {}
 };
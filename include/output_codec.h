@@ -0,0 +1,83 @@
+/*© 2023. Triad National Security, LLC. All rights reserved.
+This program was produced under U.S. Government contract 89233218CNA000001 for Los Alamos
+National Laboratory (LANL), which is operated by Triad National Security, LLC for the U.S.
+Department of Energy/National Nuclear Security Administration. All rights in the program are.
+reserved by Triad National Security, LLC, and the U.S. Department of Energy/National Nuclear
+Security Administration. The Government is granted for itself and others acting on its behalf a
+nonexclusive, paid-up, irrevocable worldwide license in this material to reproduce, prepare.
+derivative works, distribute copies to the public, perform publicly and display publicly, and to permit.
+others to do so.*/
+
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// header of the binary cell output files:
+//   char[4]  "NUDB" (raw records) or "NUDZ" (compressed blocks)
+//   uint32   version, byte order probe 0x01020304 (in the writer's order)
+//   uint32   number of grains, bins, grain sizes, values per record
+//   uint32   length of the grain name line, then that many chars
+//   double   grain sizes
+//   double   initial values
+// a NUDB file follows with one record per dump: double time, double values.
+// a NUDZ file follows with blocks of records:
+//   uint32   records in the block, method, encoded bytes, stored bytes
+//   char     stored bytes
+// within a block every record (time and values, as 64 bit words) is
+// XORed with the record before it, so values that did not change become
+// zero words. each record is then written as (zero words, literal words,
+// the literals) runs with varint counts, and method 1 deflates the result.
+// blocks do not depend on each other.
+struct observer_header
+{
+  static constexpr char     MAGIC[4]            = { 'N', 'U', 'D', 'B' };
+  static constexpr char     MAGIC_COMPRESSED[4] = { 'N', 'U', 'D', 'Z' };
+  static constexpr uint32_t VERSION             = 1;
+  static constexpr uint32_t ORDER_PROBE         = 0x01020304;
+
+  uint32_t n_grains;
+  uint32_t n_bins;
+  uint32_t n_sizes;
+  uint32_t n_values;
+  std::string grain_names;
+};
+
+namespace output_codec
+{
+enum : uint32_t { STORED = 0, DEFLATE = 1 };
+
+// encode n_rows rows of row_len doubles into a block, header included
+void encode_block(const double* rows, size_t n_rows, size_t row_len, std::string& out);
+
+// decode the encoded (not stored) bytes of a block
+bool decode_rows(const unsigned char* p, const unsigned char* end, size_t n_rows, size_t row_len,
+                 std::vector<uint64_t>& words);
+} // namespace output_codec
+
+// reads the records of a NUDB or NUDZ file, in the byte order of the
+// machine reading it
+class output_reader
+{
+  std::ifstream in;
+  bool swapped    = false;
+  bool compressed = false;
+
+  // decoded records of the current block, time first in each
+  std::vector<double> block;
+  size_t block_rows = 0;
+  size_t block_pos  = 0;
+
+  bool read_block();
+
+public:
+  observer_header     header;
+  std::vector<double> grain_sizes;
+  std::vector<double> initial;
+
+  bool open(const std::string& filename);
+  // the next record; false at the end of the file or at a cut short record
+  bool next(double& time, std::vector<double>& values);
+};
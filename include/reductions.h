@@ -0,0 +1,91 @@
+/*© 2023. Triad National Security, LLC. All rights reserved.
+This program was produced under U.S. Government contract 89233218CNA000001 for Los Alamos
+National Laboratory (LANL), which is operated by Triad National Security, LLC for the U.S.
+Department of Energy/National Nuclear Security Administration. All rights in the program are.
+reserved by Triad National Security, LLC, and the U.S. Department of Energy/National Nuclear
+Security Administration. The Government is granted for itself and others acting on its behalf a
+nonexclusive, paid-up, irrevocable worldwide license in this material to reproduce, prepare.
+derivative works, distribute copies to the public, perform publicly and display publicly, and to permit.
+others to do so.*/
+
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// in-situ reductions over all cells, sampled on a common time grid:
+//   dust mass per grain species, from the third moment of each grain
+//   dust volume per grain species and size bin (the mass weighted size
+//   distribution, up to the bulk density of the grain)
+//   the condensation efficiency of every cell (its "shell") at its end
+// observers add their cell's values into an accumulator owned by the
+// calling thread, so sampling takes no lock. write() merges the threads
+// and, with MPI, the ranks (MPI_Reduce) and writes one summary file on
+// rank 0.
+// the sums are not kept in restart files. a run that skips cells finished
+// earlier, stops before its cells end or resumes cells from their restart
+// files only holds part of the totals, and its summary is written under a
+// _partial name so it is not mistaken for the whole
+class cell_reductions
+{
+public:
+  // the values of one cell at one grid time
+  struct sample
+  {
+    std::vector<double> mass;      // per grain
+    std::vector<double> sd_volume; // per grain and bin
+  };
+
+private:
+  struct accumulator
+  {
+    std::vector<double> mass;      // [time][grain]
+    std::vector<double> sd_volume; // [time][grain][bin]
+    std::vector<double> n_cells;   // [time]
+    std::vector<uint32_t> cids;    // cells that finished, with
+    std::vector<double> efficiency; // [cell][grain] of each
+    double n_resumed = 0;           // finished cells that were resumed
+  };
+
+  uint64_t id; // tells the thread local accumulators of two instances apart
+  std::mutex lock;
+  std::vector<std::shared_ptr<accumulator>> accumulators;
+
+  accumulator& local();
+
+public:
+  static cell_reductions* active; // reductions the observers of this rank feed
+
+  std::vector<double>      times;
+  std::vector<std::string> grain_names;
+  std::vector<double>      bin_sizes;
+
+  size_t n_cells; // cells of the whole simulation, on every rank
+
+  cell_reductions(std::vector<double> times, std::vector<std::string> grain_names, std::vector<double> bin_sizes,
+                  size_t n_cells);
+
+  cell_reductions(const cell_reductions&) = delete;
+  cell_reductions& operator=(const cell_reductions&) = delete;
+
+  size_t n_grains() const { return grain_names.size(); }
+  size_t n_bins() const { return bin_sizes.size(); }
+
+  // add one cell's values at grid time k
+  void add(size_t k, const sample& s);
+  // condensation efficiency of each grain of a cell at its end. resumed
+  // tells that the cell was not sampled before its restart point
+  void add_final(uint32_t cid, const std::vector<double>& efficiency, bool resumed);
+
+  // merge the accumulators of every thread and rank and write the summary
+  // on rank 0, to stem.dat when every cell was integrated whole in this run
+  // and to stem_partial.dat otherwise. collective
+  void write(const std::string& stem);
+
+  // n times from t_min to t_max, evenly spaced in log time
+  static std::vector<double> log_grid(double t_min, double t_max, int n);
+};
@@ -0,0 +1,57 @@
+/*© 2023. Triad National Security, LLC. All rights reserved.
+This program was produced under U.S. Government contract 89233218CNA000001 for Los Alamos
+National Laboratory (LANL), which is operated by Triad National Security, LLC for the U.S.
+Department of Energy/National Nuclear Security Administration. All rights in the program are.
+reserved by Triad National Security, LLC, and the U.S. Department of Energy/National Nuclear
+Security Administration. The Government is granted for itself and others acting on its behalf a
+nonexclusive, paid-up, irrevocable worldwide license in this material to reproduce, prepare.
+derivative works, distribute copies to the public, perform publicly and display publicly, and to permit.
+others to do so.*/
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// binary restart file of one cell:
+//   char[4]  "NUDR"
+//   uint32   version, byte order probe 0x01020304
+//   uint64   hash of the network file
+//   uint64   output mark: bytes of the output file (rows of the hdf5
+//            datasets) written up to this restart
+//   uint64   number of vd, delSZ and state values
+//   double   time, vd, delSZ, state (full network layout)
+//   uint64   FNV-1a of everything before it
+// files are written to a temporary, synced and renamed over the old one,
+// so a restart file is either the previous one or complete.
+struct restart_state
+{
+  double              time        = 0.0;
+  uint64_t            output_mark = 0;
+  std::vector<double> vd;
+  std::vector<double> delSZ;
+  std::vector<double> x;
+};
+
+namespace restart_file
+{
+constexpr uint32_t VERSION = 1;
+
+// the file contents, in buf
+void encode(uint64_t net_hash, double time, uint64_t output_mark, const std::vector<double>& vd,
+            const std::vector<double>& delSZ, const std::vector<double>& x, std::string& buf);
+
+// buf is scratch space kept by the caller between writes
+bool write(const std::string& filename, uint64_t net_hash, double time, uint64_t output_mark,
+           const std::vector<double>& vd, const std::vector<double>& delSZ, const std::vector<double>& x,
+           std::string& buf);
+
+// false, with a warning logged, if the file is missing, damaged or was
+// written for another network
+bool read(const std::string& filename, uint64_t net_hash, restart_state& state);
+
+// check and unpack file contents read elsewhere. filename is only used in
+// the warnings
+bool decode(const std::string& buf, const std::string& filename, uint64_t net_hash, restart_state& state);
+} // namespace restart_file
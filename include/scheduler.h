@@ -0,0 +1,77 @@
+/*© 2023. Triad National Security, LLC. All rights reserved.
+This program was produced under U.S. Government contract 89233218CNA000001 for Los Alamos
+National Laboratory (LANL), which is operated by Triad National Security, LLC for the U.S.
+Department of Energy/National Nuclear Security Administration. All rights in the program are.
+reserved by Triad National Security, LLC, and the U.S. Department of Energy/National Nuclear
+Security Administration. The Government is granted for itself and others acting on its behalf a
+nonexclusive, paid-up, irrevocable worldwide license in this material to reproduce, prepare.
+derivative works, distribute copies to the public, perform publicly and display publicly, and to permit.
+others to do so.*/
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// fixed set of worker threads, each with its own task deque. a worker
+// takes tasks from the front of its own deque and, when that is empty,
+// steals from the front of the others. run() deals the tasks out round
+// robin in the order given, so passing them most expensive first starts
+// the long tasks early on every worker, and a thief also takes the most
+// expensive task left, keeping the short ones for the end.
+class work_pool
+{
+  struct worker_queue
+  {
+    std::mutex                        lock;
+    std::deque<std::function<void()>> tasks;
+  };
+
+  std::vector<std::unique_ptr<worker_queue>> queues;
+  std::vector<std::thread>                   threads;
+
+  std::atomic<int>        n_idle { 0 };  // workers asleep waiting for work
+
+  // the pool and worker index of the calling thread, if it is a worker
+  static thread_local work_pool* current_pool;
+  static thread_local size_t     current_worker;
+
+  std::mutex              state_lock;
+  std::condition_variable work_ready;
+  std::condition_variable work_done;
+  size_t                  n_pending = 0; // queued or running
+  uint64_t                generation = 0;
+  bool                    stopping  = false;
+
+  bool pop_own(size_t w, std::function<void()>& task);
+  bool steal(size_t w, std::function<void()>& task);
+  void worker_loop(size_t w);
+
+public:
+  explicit work_pool(int n_threads);
+  ~work_pool();
+
+  work_pool(const work_pool&) = delete;
+  work_pool& operator=(const work_pool&) = delete;
+
+  size_t size() const { return threads.size(); }
+
+  // run every task and wait for all of them to finish
+  void run(std::vector<std::function<void()>>& tasks);
+
+  // run body(i) for i in [0, n) and wait. when called from a worker whose
+  // pool has idle threads, helper tasks are queued at the front of the
+  // caller's deque, where they are stolen first; otherwise (or if no
+  // helper gets there first) the caller runs the indices itself
+  static void parallel_for(size_t n, const std::function<void(size_t)>& body);
+
+  // number of threads to use for a requested count, 0 meaning an equal
+  // share of the cores for each of the ranks_per_node ranks on the node
+  static int resolve_threads(int requested, int ranks_per_node = 1);
+};
@@ -0,0 +1,29 @@
+/*© 2023. Triad National Security, LLC. All rights reserved.
+This program was produced under U.S. Government contract 89233218CNA000001 for Los Alamos
+National Laboratory (LANL), which is operated by Triad National Security, LLC for the U.S.
+Department of Energy/National Nuclear Security Administration. All rights in the program are.
+reserved by Triad National Security, LLC, and the U.S. Department of Energy/National Nuclear
+Security Administration. The Government is granted for itself and others acting on its behalf a
+nonexclusive, paid-up, irrevocable worldwide license in this material to reproduce, prepare.
+derivative works, distribute copies to the public, perform publicly and display publicly, and to permit.
+others to do so.*/
+
+
+#pragma once
+
+// stopping a run early on SIGTERM or SIGUSR1, as sent by batch schedulers
+// before preempting or ending a job. once a signal has arrived, running
+// cells write a restart file at their next accepted step and return, and
+// no further cells are started, so the run ends normally and can be
+// continued from the restart files.
+namespace stop_request
+{
+// install the handlers. signals before this keep their default action
+void install();
+
+// whether a stop signal has arrived
+bool pending();
+
+// the signal that arrived, 0 if none
+int signal_number();
+} // namespace stop_request
@@ -0,0 +1,48 @@
+/*© 2023. Triad National Security, LLC. All rights reserved.
+This program was produced under U.S. Government contract 89233218CNA000001 for Los Alamos
+National Laboratory (LANL), which is operated by Triad National Security, LLC for the U.S.
+Department of Energy/National Nuclear Security Administration. All rights in the program are.
+reserved by Triad National Security, LLC, and the U.S. Department of Energy/National Nuclear
+Security Administration. The Government is granted for itself and others acting on its behalf a
+nonexclusive, paid-up, irrevocable worldwide license in this material to reproduce, prepare.
+derivative works, distribute copies to the public, perform publicly and display publicly, and to permit.
+others to do so.*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+#ifdef NUDUSTC_ENABLE_MPI
+#include <mpi.h>
+#endif
+
+// hands out batches of indices into a task list that every rank holds in
+// the same order. with MPI the next index lives in an RMA window on rank 0
+// and is advanced with MPI_Fetch_and_op, so ranks (and their threads) take
+// work as they become free instead of owning a fixed block. constructing
+// and destroying the counter are collective.
+class task_counter
+{
+  size_t n_tasks;
+  size_t batch;
+  std::mutex lock; // MPI calls from the worker threads are serialized
+
+#ifdef NUDUSTC_ENABLE_MPI
+  MPI_Win  win;
+  int64_t* next = nullptr;
+#else
+  size_t next = 0;
+#endif
+
+public:
+  task_counter(size_t n_tasks, size_t batch);
+  ~task_counter();
+
+  task_counter(const task_counter&) = delete;
+  task_counter& operator=(const task_counter&) = delete;
+
+  // claim the next batch [begin, end). false once every task is handed out
+  bool claim(size_t& begin, size_t& end);
+};
@@ -0,0 +1,90 @@
+/*© 2023. Triad National Security, LLC. All rights reserved.
+This program was produced under U.S. Government contract 89233218CNA000001 for Los Alamos
+National Laboratory (LANL), which is operated by Triad National Security, LLC for the U.S.
+Department of Energy/National Nuclear Security Administration. All rights in the program are.
+reserved by Triad National Security, LLC, and the U.S. Department of Energy/National Nuclear
+Security Administration. The Government is granted for itself and others acting on its behalf a
+nonexclusive, paid-up, irrevocable worldwide license in this material to reproduce, prepare.
+derivative works, distribute copies to the public, perform publicly and display publicly, and to permit.
+others to do so.*/
+
+#pragma once
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// character level helpers shared by the text loaders
+namespace text
+{
+
+inline bool is_blank(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+inline const char* skip_blank(const char* p, const char* end)
+{
+  while (p < end && is_blank(*p)) ++p;
+  return p;
+}
+
+inline const char* end_of_line(const char* p, const char* end)
+{
+  return std::find(p, end, '\n');
+}
+
+// parse a number and advance p. a leading '+' is accepted like lexical_cast
+template<typename T>
+inline bool parse_token(const char*& p, const char* end, T& val)
+{
+  p = skip_blank(p, end);
+  if (p < end && *p == '+') ++p;
+  auto res = std::from_chars(p, end, val);
+  if (res.ec != std::errc()) return false;
+  p = res.ptr;
+  return true;
+}
+
+// whitespace separated words of a header line
+std::vector<std::string> split_words(std::string_view line);
+
+} // namespace text
+
+// the rows parsed by one thread: a cell id followed by its values
+struct table_chunk
+{
+  std::vector<uint32_t> ids;
+  std::vector<size_t>   offsets { 0 }; // row r is vals[offsets[r], offsets[r+1])
+  std::vector<double>   vals;
+  size_t bad_byte = std::string::npos;   // first line that did not parse
+
+  size_t n_rows() const { return ids.size(); }
+  size_t width(size_t r) const { return offsets[r + 1] - offsets[r]; }
+  const double* row(size_t r) const { return vals.data() + offsets[r]; }
+};
+
+// a memory mapped whitespace separated table of "<cell id> <values...>"
+// rows below a few header lines. the rows are split into line aligned
+// chunks that are parsed concurrently, each into its own table_chunk.
+// parse_rows can be limited to a sorted list of cell ids; other rows are
+// skipped after reading their id.
+struct text_table
+{
+  boost::interprocess::file_mapping  file;
+  boost::interprocess::mapped_region region;
+  const char* data = nullptr;
+  size_t size      = 0;
+  size_t pos       = 0; // start of the next unread line
+
+  bool open(const std::string& filename);
+  std::string_view next_line();
+  std::vector<uint32_t> scan_ids(int n_threads) const;
+  std::vector<table_chunk> parse_rows(int n_threads, const std::vector<uint32_t>* keep = nullptr) const;
+
+private:
+  std::vector<const char*> chunk_bounds(int n_threads) const;
+};
@@ -10,31 +10,77 @@ others to do so.*/
 
 #pragma once
 
-#include<string>
-#include<chrono>
-#include <unistd.h>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
 
 using tpoint = std::chrono::time_point<std::chrono::steady_clock>;
-using trec = std::map<std::string, std::vector<double>>;
 
-inline trec benchmark_map;
+// call count, total and a log scale histogram of the durations of one
+// timed scope. each power of two of ns is split into four buckets, so
+// percentiles read from it are within about 12%
+struct timing_stats
+{
+  static constexpr size_t N_BUCKETS = 256;
+
+  uint64_t count    = 0;
+  uint64_t total_ns = 0;
+  uint64_t max_ns   = 0;
+  std::array<uint64_t, N_BUCKETS> buckets {};
+
+  static size_t bucket_of(uint64_t ns)
+  {
+    if (ns < 2) return 0;
+    int octave = 63 - __builtin_clzll(ns);
+    // the two bits below the leading one pick the quarter octave
+    uint64_t quarter = (octave >= 2) ? (ns >> (octave - 2)) & 3 : (ns << (2 - octave)) & 3;
+    return 4 * octave + quarter;
+  }
+
+  void add(uint64_t ns)
+  {
+    ++count;
+    total_ns += ns;
+    if (ns > max_ns) max_ns = ns;
+    ++buckets[bucket_of(ns)];
+  }
+
+  void merge(const timing_stats& o);
+  double percentile(double q) const; // ns
+};
+
+// timed scopes are registered by name once per call site and then
+// recorded by id into a table owned by the recording thread, so timing
+// takes no lock. the tables of all threads (including exited ones) are
+// only read by report(), once the timed work has finished
+namespace timing_registry
+{
+size_t id(const std::string& name);
+void record(size_t id, uint64_t ns);
+
+// merge the tables of every thread and, with MPI, every rank and write
+// a table of counts, totals and percentiles on rank 0. collective
+void report(std::ostream& os);
+}
 
 struct Timer
 {
-    std::string fn;
+    size_t id;
     tpoint start;
-    Timer(std::string fn)
-        : fn(std::move(fn)), start(std::chrono::steady_clock::now())
+    explicit Timer(size_t id)
+        : id(id), start(std::chrono::steady_clock::now())
     {
     }
     ~Timer()
     {
         const auto elapsed =
-            std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
-//       printf("%s: function=%s; elasepd=%f ms\n", title.c_str(), fn.c_str(), elapsed / 1000.0);
-        benchmark_map[fn].push_back(static_cast<double>(elapsed));
+            std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        timing_registry::record(id, static_cast<uint64_t>(elapsed));
     }
-  
 };
 
 
@@ -42,11 +88,16 @@ struct Timer
 static constexpr inline void dummy_fn() { }
 #define START_BENCHMARK_TIMER(...) dummy_fn()
 #else
-#define START_BENCHMARK_TIMER(title) Timer timer(title)
+// the name is looked up once per call site
+#define START_BENCHMARK_TIMER(title) \
+  static const size_t benchmark_timer_id = timing_registry::id(title); \
+  Timer benchmark_timer(benchmark_timer_id)
 #endif
 
 template<class F, typename ...Args>
-auto time_fn(std::string fn_name, F&& fn, Args&&... args ) {
-  START_BENCHMARK_TIMER(fn_name);
+auto time_fn(const std::string& fn_name, F&& fn, Args&&... args ) {
+#ifdef ENABLE_BENCHMARK
+  Timer timer(timing_registry::id(fn_name));
+#endif
   return fn(std::forward<Args>(args)...);
 }
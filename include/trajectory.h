@@ -0,0 +1,63 @@
+/*© 2023. Triad National Security, LLC. All rights reserved.
+This program was produced under U.S. Government contract 89233218CNA000001 for Los Alamos
+National Laboratory (LANL), which is operated by Triad National Security, LLC for the U.S.
+Department of Energy/National Nuclear Security Administration. All rights in the program are.
+reserved by Triad National Security, LLC, and the U.S. Department of Energy/National Nuclear
+Security Administration. The Government is granted for itself and others acting on its behalf a
+nonexclusive, paid-up, irrevocable worldwide license in this material to reproduce, prepare.
+derivative works, distribute copies to the public, perform publicly and display publicly, and to permit.
+others to do so.*/
+
+#pragma once
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+struct cell_input;
+
+// one time entry of the trajectory file: the time line followed by one
+// line per cell
+struct trajectory_block
+{
+  double time;
+  size_t begin;   // first byte after the time line
+  size_t end;     // one past the last byte of the block
+  bool   sorted;  // cell ids ascend within the block
+};
+
+// byte index over a memory mapped trajectory (environment) file. the file
+// is scanned once to find the time blocks; cell data is only parsed for
+// the cells that are asked for, so memory scales with the cells loaded
+// rather than the file size.
+struct trajectory_index
+{
+  boost::interprocess::file_mapping  file;
+  boost::interprocess::mapped_region region;
+  const char* data = nullptr;
+  size_t size      = 0;
+
+  std::vector<trajectory_block> blocks;
+
+  // the cell lines of blocks that cannot be binary searched, ordered by
+  // cell id and then by position, so a cell's lines are found directly
+  struct cell_line
+  {
+    uint32_t cid;
+    size_t   offset;
+  };
+  std::vector<cell_line> unsorted_lines;
+
+  bool open(const std::string& filename);
+  void load_cells(const std::vector<uint32_t>& cids, std::map<uint32_t, cell_input>& inputs) const;
+  void load_cell(uint32_t cid, cell_input& input) const;
+
+private:
+  size_t lower_line(const trajectory_block& b, uint32_t cid) const;
+  void scan(const std::vector<uint32_t>& cids, const std::function<cell_input&(uint32_t)>& sink) const;
+};
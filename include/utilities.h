@@ -10,9 +10,24 @@ others to do so.*/
 
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+
 namespace utilities
 {
 
+// FNV-1a, continued from h when hashing in pieces
+inline uint64_t fnv1a(const void* data, size_t len, uint64_t h = 14695981039346656037ULL)
+{
+  auto p = static_cast<const unsigned char*>(data);
+  for (size_t i = 0; i < len; ++i)
+  {
+    h ^= p[i];
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
 template<class T>
 inline constexpr auto square(const T& value){
   return value * value;
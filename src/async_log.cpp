@@ -0,0 +1,148 @@
+/*© 2023. Triad National Security, LLC. All rights reserved.
+This program was produced under U.S. Government contract 89233218CNA000001 for Los Alamos
+National Laboratory (LANL), which is operated by Triad National Security, LLC for the U.S.
+Department of Energy/National Nuclear Security Administration. All rights in the program are.
+reserved by Triad National Security, LLC, and the U.S. Department of Energy/National Nuclear
+Security Administration. The Government is granted for itself and others acting on its behalf a
+nonexclusive, paid-up, irrevocable worldwide license in this material to reproduce, prepare.
+derivative works, distribute copies to the public, perform publicly and display publicly, and to permit.
+others to do so.*/
+
+#include "async_log.h"
+
+#include <plog/Init.h>
+#include <plog/Formatters/TxtFormatter.h>
+
+#include <boost/filesystem.hpp>
+
+#include <chrono>
+
+namespace
+{
+constexpr auto FLUSH_INTERVAL = std::chrono::milliseconds(250);
+}
+
+async_file_appender::async_file_appender(const std::string& filename)
+  : out(filename, std::ios::out | std::ios::trunc)
+{
+  writer = std::thread(&async_file_appender::writer_loop, this);
+}
+
+async_file_appender::~async_file_appender()
+{
+  {
+    std::lock_guard<std::mutex> g(wake_lock);
+    stopping = true;
+  }
+  wake.notify_one();
+  writer.join();
+}
+
+// the buffer of the calling thread, registered on its first record. the
+// registry shares ownership so lines of threads that have exited are
+// still written
+async_file_appender::thread_buffer&
+async_file_appender::local_buffer()
+{
+  thread_local const async_file_appender* owner = nullptr;
+  thread_local std::shared_ptr<thread_buffer> buf;
+  if (owner != this)
+  {
+    buf   = std::make_shared<thread_buffer>();
+    owner = this;
+    std::lock_guard<std::mutex> g(registry_lock);
+    buffers.push_back(buf);
+  }
+  return *buf;
+}
+
+void
+async_file_appender::write(const plog::Record& record)
+{
+  auto line = plog::TxtFormatter::format(record);
+  auto& buf = local_buffer();
+  {
+    std::lock_guard<std::mutex> g(buf.lock);
+    buf.text.append(line.begin(), line.end());
+  }
+  if (record.getSeverity() <= plog::warning)
+  {
+    {
+      std::lock_guard<std::mutex> g(wake_lock);
+      urgent = true;
+    }
+    wake.notify_one();
+  }
+}
+
+void
+async_file_appender::drain()
+{
+  std::vector<std::shared_ptr<thread_buffer>> live;
+  {
+    std::lock_guard<std::mutex> g(registry_lock);
+    live = buffers;
+  }
+  std::string text;
+  for (auto& buf: live)
+  {
+    {
+      std::lock_guard<std::mutex> g(buf->lock);
+      text.swap(buf->text);
+    }
+    out << text;
+    text.clear();
+  }
+  out.flush();
+  live.clear();
+
+  // forget the buffers of exited threads once they are empty
+  std::lock_guard<std::mutex> g(registry_lock);
+  for (size_t b = 0; b < buffers.size();)
+  {
+    bool orphan = buffers[b].use_count() == 1;
+    if (orphan)
+    {
+      std::lock_guard<std::mutex> gb(buffers[b]->lock);
+      orphan = buffers[b]->text.empty();
+    }
+    if (orphan)
+    {
+      buffers[b] = std::move(buffers.back());
+      buffers.pop_back();
+    }
+    else ++b;
+  }
+}
+
+void
+async_file_appender::writer_loop()
+{
+  std::unique_lock<std::mutex> g(wake_lock);
+  while (!stopping)
+  {
+    wake.wait_for(g, FLUSH_INTERVAL, [&] { return urgent || stopping; });
+    urgent = false;
+    g.unlock();
+    drain();
+    g.lock();
+  }
+  g.unlock();
+  drain();
+}
+
+std::string
+rank_log_name(const std::string& filename, int rank, int size)
+{
+  if (size == 1) return filename;
+  boost::filesystem::path p(filename);
+  auto name = p.stem().string() + "_r" + std::to_string(rank) + p.extension().string();
+  return (p.parent_path() / name).string();
+}
+
+void
+init_async_log(const std::string& filename, plog::Severity severity)
+{
+  static async_file_appender appender(filename);
+  plog::init(severity, &appender);
+}
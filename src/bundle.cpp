@@ -0,0 +1,296 @@
+/*© 2023. Triad National Security, LLC. All rights reserved.
+This program was produced under U.S. Government contract 89233218CNA000001 for Los Alamos
+National Laboratory (LANL), which is operated by Triad National Security, LLC for the U.S.
+Department of Energy/National Nuclear Security Administration. All rights in the program are.
+reserved by Triad National Security, LLC, and the U.S. Department of Energy/National Nuclear
+Security Administration. The Government is granted for itself and others acting on its behalf a
+nonexclusive, paid-up, irrevocable worldwide license in this material to reproduce, prepare.
+derivative works, distribute copies to the public, perform publicly and display publicly, and to permit.
+others to do so.*/
+
+#include "bundle.h"
+
+#include "cell.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <boost/filesystem.hpp>
+#include <plog/Log.h>
+
+namespace
+{
+
+const char BUNDLE_MAGIC[8] = { 'N', 'U', 'D', 'B', 'N', 'D', 'L', '\0' };
+
+inline uint64_t align8(uint64_t n) { return (n + 7) & ~uint64_t(7); }
+
+// the cell_input vector behind each column
+const std::vector<double>& input_column(const cell_input& in, int col)
+{
+  switch (col)
+  {
+    case BCOL_INIT_ABUND: return in.inp_init_abund;
+    case BCOL_SIZE_DIST:  return in.inp_size_dist;
+    case BCOL_VD:         return in.inp_vd;
+    case BCOL_TIMES:      return in.inp_times;
+    case BCOL_TEMP:       return in.inp_temp;
+    case BCOL_VOLUMES:    return in.inp_volumes;
+    case BCOL_RHO:        return in.inp_rho;
+    case BCOL_PRESSURE:   return in.inp_pressure;
+    case BCOL_VELO:       return in.inp_velo;
+    default:              return in.inp_x_cm;
+  }
+}
+
+std::vector<double>& input_column(cell_input& in, int col)
+{
+  return const_cast<std::vector<double>&>(input_column(static_cast<const cell_input&>(in), col));
+}
+
+inline bool is_env_column(int col)
+{
+  return col >= BCOL_TIMES && col <= BCOL_X_CM;
+}
+
+} // namespace
+
+// map a bundle and check its header. returns false if it is not a bundle
+bool
+input_bundle::open(const std::string& filename)
+{
+  namespace bip = boost::interprocess;
+
+  if (!boost::filesystem::exists(filename) || boost::filesystem::file_size(filename) < sizeof(bundle_header))
+  {
+    return false;
+  }
+  file   = bip::file_mapping(filename.c_str(), bip::read_only);
+  region = bip::mapped_region(file, bip::read_only);
+  data   = static_cast<const char*>(region.get_address());
+  size   = region.get_size();
+  header = reinterpret_cast<const bundle_header*>(data);
+  if (std::memcmp(header->magic, BUNDLE_MAGIC, sizeof(BUNDLE_MAGIC)) != 0 || header->version != BUNDLE_VERSION)
+  {
+    PLOGE << filename << " is not a version " << BUNDLE_VERSION << " input bundle";
+    return false;
+  }
+  if (!check_layout(filename)) return false;
+  cells = reinterpret_cast<const bundle_cell*>(data + header->cells_offset);
+  return true;
+}
+
+// every section and column of a truncated or corrupt bundle would point
+// past the mapping; check them all once so later reads need no checks
+bool
+input_bundle::check_layout(const std::string& filename) const
+{
+  // [offset, offset + count * width) lies inside the file and is aligned
+  auto fits = [&](uint64_t offset, uint64_t count, uint64_t width) {
+    return offset % 8 == 0 && offset <= size && count <= (size - offset) / width;
+  };
+  const auto& h = *header;
+  uint64_t n_edges = h.n_bins ? h.n_bins + 1 : 0;
+  const char* bad = nullptr;
+  if (!fits(h.names_offset, h.names_bytes, 1) ||
+      (h.names_bytes > 0 && data[h.names_offset + h.names_bytes - 1] != '\0'))
+    bad = "element names";
+  else if (!fits(h.bins_offset, h.n_bins + n_edges, sizeof(double)))
+    bad = "size bins";
+  else if (!fits(h.cells_offset, h.n_cells, sizeof(bundle_cell)))
+    bad = "cell table";
+  if (bad)
+  {
+    PLOGE << "input bundle " << filename << " is truncated or corrupt at its " << bad << " (file is " << size
+          << " bytes)";
+    return false;
+  }
+  auto table = reinterpret_cast<const bundle_cell*>(data + h.cells_offset);
+  for (size_t i = 0; i < h.n_cells; ++i)
+  {
+    for (int col = 0; col < BCOL_N_COLUMNS; ++col)
+    {
+      if (!fits(table[i].offset[col], table[i].length[col], sizeof(double)))
+      {
+        PLOGE << "input bundle " << filename << " is truncated or corrupt at column " << col << " of cell "
+              << table[i].cid << " (file is " << size << " bytes)";
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+std::vector<std::string>
+input_bundle::element_names() const
+{
+  std::vector<std::string> names;
+  const char* p   = data + header->names_offset;
+  const char* end = p + header->names_bytes;
+  while (p < end)
+  {
+    names.emplace_back(p);
+    p += names.back().size() + 1;
+  }
+  return names;
+}
+
+double_span
+input_bundle::size_bins() const
+{
+  return { reinterpret_cast<const double*>(data + header->bins_offset), header->n_bins };
+}
+
+double_span
+input_bundle::bin_edges() const
+{
+  auto bins = size_bins();
+  return { bins.end(), header->n_bins ? header->n_bins + 1 : 0 };
+}
+
+std::vector<uint32_t>
+input_bundle::cell_ids() const
+{
+  std::vector<uint32_t> ids(header->n_cells);
+  for (size_t i = 0; i < ids.size(); ++i) ids[i] = cells[i].cid;
+  return ids;
+}
+
+const bundle_cell*
+input_bundle::find(uint32_t cid) const
+{
+  auto end = cells + header->n_cells;
+  auto it  = std::lower_bound(cells, end, cid, [](const bundle_cell& c, uint32_t id) { return c.cid < id; });
+  return (it == end || it->cid != cid) ? nullptr : it;
+}
+
+double_span
+input_bundle::column(const bundle_cell& c, bundle_column col) const
+{
+  return { reinterpret_cast<const double*>(data + c.offset[col]), c.length[col] };
+}
+
+// fill inputs for the given cells straight from the mapped columns
+void
+input_bundle::load_cells(const std::vector<uint32_t>& cids, std::map<uint32_t, cell_input>& inputs, bool with_env) const
+{
+  auto bins  = size_bins();
+  auto edges = bin_edges();
+  for (const auto& cid: cids)
+  {
+    auto c = find(cid);
+    if (c == nullptr)
+    {
+      PLOGE << "cell " << cid << " is not in the input bundle";
+      exit(1);
+    }
+    auto& in = inputs[cid];
+    for (int col = 0; col < BCOL_N_COLUMNS; ++col)
+    {
+      if (!with_env && is_env_column(col)) continue;
+      auto span = column(*c, static_cast<bundle_column>(col));
+      input_column(in, col).assign(span.begin(), span.end());
+    }
+    in.inp_cell_time  = c->cell_time;
+    in.inp_shock_time = c->shock_time;
+    in.inp_shock_temp = c->shock_temp;
+    if (header->flags & BUNDLE_HAS_SIZE_DIST)
+    {
+      in.inp_binSizes.assign(bins.begin(), bins.end());
+      in.inp_binEdges.assign(edges.begin(), edges.end());
+      in.inp_delSZ.assign(in.inp_size_dist.size(), 0.0);
+    }
+  }
+}
+
+// copy only the environment columns of one cell, for cells loaded
+// without them
+void
+input_bundle::load_env(uint32_t cid, cell_input& input) const
+{
+  auto c = find(cid);
+  if (c == nullptr)
+  {
+    PLOGE << "cell " << cid << " is not in the input bundle";
+    exit(1);
+  }
+  for (int col = BCOL_TIMES; col <= BCOL_X_CM; ++col)
+  {
+    auto span = column(*c, static_cast<bundle_column>(col));
+    input_column(input, col).assign(span.begin(), span.end());
+  }
+}
+
+// write the loaded inputs of every cell as a bundle
+void
+input_bundle::write(const std::string& filename,
+                    uint32_t flags,
+                    const std::vector<std::string>& elements,
+                    uint32_t n_grains,
+                    const std::vector<double>& size_bins,
+                    const std::vector<double>& bin_edges,
+                    const std::map<uint32_t, cell_input>& inputs)
+{
+  bundle_header h{};
+  std::memcpy(h.magic, BUNDLE_MAGIC, sizeof(BUNDLE_MAGIC));
+  h.version    = BUNDLE_VERSION;
+  h.flags      = flags;
+  h.n_cells    = inputs.size();
+  h.n_elements = elements.size();
+  h.n_grains   = n_grains;
+  h.n_bins     = size_bins.size();
+
+  std::string names;
+  for (const auto& e: elements) names += e + '\0';
+  h.names_offset = align8(sizeof(bundle_header));
+  h.names_bytes  = names.size();
+  h.bins_offset  = align8(h.names_offset + h.names_bytes);
+  h.cells_offset = align8(h.bins_offset + sizeof(double) * (size_bins.size() + bin_edges.size()));
+
+  std::vector<bundle_cell> table;
+  table.reserve(inputs.size());
+  uint64_t offset = h.cells_offset + sizeof(bundle_cell) * inputs.size();
+  for (const auto& [cid, in]: inputs)
+  {
+    bundle_cell c{};
+    c.cid        = cid;
+    c.cell_time  = in.inp_cell_time;
+    c.shock_time = in.inp_shock_time;
+    c.shock_temp = in.inp_shock_temp;
+    for (int col = 0; col < BCOL_N_COLUMNS; ++col)
+    {
+      c.offset[col] = offset;
+      c.length[col] = input_column(in, col).size();
+      offset += sizeof(double) * c.length[col];
+    }
+    table.push_back(c);
+  }
+
+  std::ofstream ofs(filename, std::ios::binary);
+  if (!ofs.is_open())
+  {
+    PLOGE << "Cannot open bundle file " << filename;
+    exit(1);
+  }
+  auto pad_to = [&](uint64_t pos) {
+    static const char zeros[8] = {};
+    ofs.write(zeros, pos - static_cast<uint64_t>(ofs.tellp()));
+  };
+  ofs.write(reinterpret_cast<const char*>(&h), sizeof(h));
+  pad_to(h.names_offset);
+  ofs.write(names.data(), names.size());
+  pad_to(h.bins_offset);
+  ofs.write(reinterpret_cast<const char*>(size_bins.data()), sizeof(double) * size_bins.size());
+  ofs.write(reinterpret_cast<const char*>(bin_edges.data()), sizeof(double) * bin_edges.size());
+  pad_to(h.cells_offset);
+  ofs.write(reinterpret_cast<const char*>(table.data()), sizeof(bundle_cell) * table.size());
+  for (const auto& [cid, in]: inputs)
+  {
+    for (int col = 0; col < BCOL_N_COLUMNS; ++col)
+    {
+      const auto& v = input_column(in, col);
+      ofs.write(reinterpret_cast<const char*>(v.data()), sizeof(double) * v.size());
+    }
+  }
+  PLOGI << "wrote input bundle " << filename << " with " << inputs.size() << " cells";
+}
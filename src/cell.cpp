@@ -15,7 +15,6 @@ others to do so.*/
 #include "configuration.h"
 #include "network.h"
 #include "cellobserver.h"
-#include "elements.h"
 #include "sput_params.h"
 #include "sputter.h"
 
@@ -25,7 +24,9 @@ others to do so.*/
 #include <boost/math/quadrature/gauss_kronrod.hpp>
 #include <boost/numeric/odeint.hpp>
 #include <boost/format.hpp>
-#include <plog/Log.h>
+#include "async_log.h"
+#include "timer.h"
+#include "stop_request.h"
 #include <algorithm>
 #include <boost/format.hpp>
 #include <boost/math/interpolators/makima.hpp>
@@ -37,7 +38,6 @@ others to do so.*/
 #include <cmath>
 #include <fstream>
 #include <numeric>
-#include <plog/Log.h>
 #include <string>
 #include <valarray>
 #include <vector>
@@ -49,8 +49,8 @@ using namespace std::chrono;
 
 // defined parameters needed later and call funcitons to initialize data with input data
 cell::cell ( network* n, params* sputARR, configuration* con, uint32_t id, const spec_v &init_s,
-             const cell_input &input_data )
-    : net (n), sputARR (sputARR), config (con), cid (id), elm("data/elements.json")
+             cell_input &&input_data )
+    : net (n), sputARR (sputARR), config (con), cid (id)
 {
   using constants::N_MOMENTS;
   cell_st.numReact = net->n_nucleation_reactions;
@@ -58,19 +58,168 @@ cell::cell ( network* n, params* sputARR, configuration* con, uint32_t id, const
   cell_st.numGas = init_s.size();
   set_init_data(init_s, input_data);
   set_env_data(input_data);
+  reduce_network();
   cell_st.parts.resize(cell_st.numReact);
-  reaction_switch.resize(cell_st.numReact);
-  std::fill(reaction_switch.begin(), reaction_switch.end(), true);
+  reaction_switch.assign(net->n_reactions, 1);
+  update_active_reactions();
+}
+
+// find the part of the network that can ever be active in this cell.
+// a species is available if its initial abundance is nonzero or it is made
+// by a reaction whose reactants are all available. grains whose key species
+// never become available and that start with no dust are dropped from the
+// integrated state, since nothing in the RHS can change them. a resumed
+// cell gets the same reduction as its first run: anything in its restart
+// state was either there initially or made by a reachable reaction.
+void
+cell::reduce_network()
+{
+  using constants::N_MOMENTS;
+
+  auto& x = cell_st.abund_moments_sizebins;
+  size_t numGas = cell_st.numGas;
+  size_t numBins = cell_st.numBins;
+  size_t numReact = cell_st.numReact;
+  size_t sd_start = numGas + numReact * N_MOMENTS;
+  size_t core_end = sd_start + numReact * numBins;
+
+  std::vector<bool> available(net->n_species, false);
+  for (size_t j = 0; j < std::min(cell_st.init_abund.size(), net->n_species); ++j) {
+    available[j] = cell_st.init_abund[j] > 0.0;
+  }
+  std::vector<bool> reachable(net->n_reactions, false);
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (size_t r = 0; r < net->n_reactions; ++r) {
+      if (reachable[r]) continue;
+      bool can_fire = std::all_of(net->reactants_idx[r].begin(), net->reactants_idx[r].end(),
+                                  [&](size_t idx) { return available[idx]; });
+      if (!can_fire) continue;
+      reachable[r] = true;
+      changed      = true;
+      for (const auto& p: net->products_idx[r]) available[p] = true;
+    }
+  }
+
+  layout.numGas        = numGas;
+  layout.numBins       = numBins;
+  layout.full_numReact = numReact;
+  layout.grn_map.clear();
+  for (size_t gidx = 0; gidx < numReact; ++gidx) {
+    bool can_nucleate = std::all_of(net->ks_lists_idx[gidx].begin(), net->ks_lists_idx[gidx].end(),
+                                    [&](size_t idx) { return available[idx]; });
+    auto mom_begin = x.begin() + numGas + gidx * N_MOMENTS;
+    auto bin_begin = x.begin() + sd_start + gidx * numBins;
+    bool has_dust = std::any_of(mom_begin, mom_begin + N_MOMENTS, [](double v) { return v != 0.0; }) ||
+                    std::any_of(bin_begin, bin_begin + numBins, [](double v) { return v != 0.0; });
+    if (can_nucleate || has_dust) layout.grn_map.push_back(gidx);
+  }
+  chem_reactions.clear();
+  for (const auto& r: net->chemical_reactions_idx) {
+    if (reachable[r]) chem_reactions.push_back(r);
+  }
+
+  // reduced state: gas, kept moments, kept bins, then any trailing entries
+  layout.state_map.clear();
+  for (size_t i = 0; i < numGas; ++i) layout.state_map.push_back(i);
+  for (const auto& g: layout.grn_map)
+    for (size_t j = 0; j < N_MOMENTS; ++j) layout.state_map.push_back(numGas + g * N_MOMENTS + j);
+  for (const auto& g: layout.grn_map)
+    for (size_t b = 0; b < numBins; ++b) layout.state_map.push_back(sd_start + g * numBins + b);
+  for (size_t i = core_end; i < x.size(); ++i) layout.state_map.push_back(i);
+
+  // calc_dvdt reads from the start of the full size bin block
+  std::vector<int> full_to_reduced(x.size(), -1);
+  for (size_t i = 0; i < layout.state_map.size(); ++i) full_to_reduced[layout.state_map[i]] = i;
+  dvdt_idx.resize(numGas);
+  for (size_t i = 0; i < numGas; ++i)
+    dvdt_idx[i] = sd_start + i < x.size() ? full_to_reduced[sd_start + i] : -1;
+
+  // keep only what is dropped; the integrated entries are written back
+  // over the full layout from the reduced arrays
+  auto keep_dropped = [](const std::vector<double>& v, const std::vector<bool>& kept,
+                         cell_layout::dropped& d) {
+    d.full_size = v.size();
+    d.idx.clear();
+    d.vals.clear();
+    for (size_t i = 0; i < v.size(); ++i) {
+      if (kept[i]) continue;
+      d.idx.push_back(i);
+      d.vals.push_back(v[i]);
+    }
+  };
+  std::vector<bool> kept(x.size(), false);
+  for (const auto& i: layout.state_map) kept[i] = true;
+  keep_dropped(x, kept, layout.dropped_state);
+
+  std::vector<double> reduced(layout.state_map.size());
+  for (size_t i = 0; i < reduced.size(); ++i) reduced[i] = x[layout.state_map[i]];
+  x = std::move(reduced);
+
+  // per grain x bin arrays, only when they carry the full grain layout
+  auto reduce_bins = [&](std::vector<double>& v, cell_layout::dropped& d) {
+    d = cell_layout::dropped();
+    d.full_size = v.size();
+    if (v.size() < numReact * numBins) return;
+    std::vector<bool> kept_bins(v.size(), false);
+    for (const auto& g: layout.grn_map)
+      std::fill(kept_bins.begin() + g * numBins, kept_bins.begin() + (g + 1) * numBins, true);
+    keep_dropped(v, kept_bins, d);
+    std::vector<double> rv;
+    rv.reserve(layout.grn_map.size() * numBins);
+    for (const auto& g: layout.grn_map)
+      rv.insert(rv.end(), v.begin() + g * numBins, v.begin() + (g + 1) * numBins);
+    v = std::move(rv);
+  };
+  reduce_bins(cell_st.vd, layout.dropped_vd);
+  reduce_bins(cell_st.runningTot_size_change, layout.dropped_delSZ);
+
+  cell_st.numReact = layout.grn_map.size();
+  cell_st.cbars.resize(cell_st.numReact);
+  cell_st.S.resize(cell_st.numReact);
+  cell_st.Js.resize(cell_st.numReact);
+  cell_st.dadt.resize(cell_st.numReact);
+  cell_st.ncrit.resize(cell_st.numReact);
+  cell_st.rebin_chng.resize(cell_st.numBins * cell_st.numReact);
+
+  PLOGD << "cell " << cid << ": " << cell_st.numReact << " of " << numReact << " grains, "
+        << chem_reactions.size() << " of " << net->n_chemical_reactions << " chemical reactions, state "
+        << layout.dropped_state.full_size << " -> " << x.size();
+}
+
+// scatter a reduced state back onto the full layout
+void
+cell_layout::expand_state(const std::vector<double>& x, std::vector<double>& full) const
+{
+  full.resize(dropped_state.full_size);
+  for (size_t i = 0; i < state_map.size(); ++i) full[state_map[i]] = x[i];
+  for (size_t i = 0; i < dropped_state.idx.size(); ++i) full[dropped_state.idx[i]] = dropped_state.vals[i];
+}
+
+// scatter a reduced grain x bin array back onto the full layout
+void
+cell_layout::expand_bins(const std::vector<double>& v, const dropped& d, std::vector<double>& full) const
+{
+  if (d.full_size < full_numReact * numBins)
+  {
+    full = v;
+    return;
+  }
+  full.resize(d.full_size);
+  for (size_t lg = 0; lg < grn_map.size(); ++lg)
+    std::copy(v.begin() + lg * numBins, v.begin() + (lg + 1) * numBins, full.begin() + grn_map[lg] * numBins);
+  for (size_t i = 0; i < d.idx.size(); ++i) full[d.idx[i]] = d.vals[i];
 }
 
 // resize and set initial data 
 void
-cell::set_init_data(const spec_v& init_s, const cell_input& init_data)
+cell::set_init_data(const spec_v& init_s, cell_input& init_data)
 {
   using constants::N_MOMENTS;
   
   // solution vector and abundances
-  cell_st.abund_moments_sizebins.assign(init_data.inp_solution_vector.begin(),init_data.inp_solution_vector.end());
+  cell_st.abund_moments_sizebins = std::move(init_data.inp_solution_vector);
   cell_st.init_abund.resize(cell_st.numGas);
   for (size_t i = 0; i < cell_st.numGas; ++i) {
     auto idx = net->get_species_index(init_s[i]);
@@ -86,52 +235,70 @@ cell::set_init_data(const spec_v& init_s, const cell_input& init_data)
   cell_st.ncrit.resize(net->n_nucleation_reactions);
 
   cell_st.start_time = init_data.sim_start_time;
+  cell_st.resume_time = init_data.resume_time;
+  cell_st.resume_mark = init_data.resume_output_mark;
   // vectors for binning and destruction/growth
-  cell_st.grn_sizes.assign(init_data.inp_binSizes.begin(),init_data.inp_binSizes.end());
-  cell_st.edges.assign(init_data.inp_binEdges.begin(),init_data.inp_binEdges.end());
-  cell_st.vd.assign(init_data.inp_vd.begin(),init_data.inp_vd.end());
+  cell_st.grn_sizes = std::move(init_data.inp_binSizes);
+  cell_st.edges = std::move(init_data.inp_binEdges);
+  cell_st.vd = std::move(init_data.inp_vd);
   cell_st.rebin_chng.resize(cell_st.numBins * cell_st.numReact);
-  cell_st.runningTot_size_change.assign(init_data.inp_delSZ.begin(),init_data.inp_delSZ.end());
+  cell_st.runningTot_size_change = std::move(init_data.inp_delSZ);
 
 }
 
-// load data and setup interpolators
+// take over the environment data. the interpolator is set up in solve()
 void
-cell::set_env_data(const cell_input& input_data)
+cell::set_env_data(cell_input& input_data)
 {
+  cell_st.temperature = input_data.inp_shock_temp;
   if(config->environment_file.empty())
   {
-    cell_st.temperature = input_data.inp_shock_temp;
     PLOGD << "No environment file loaded.";
     return;
   }
-  
-  env_times.assign(input_data.inp_times.begin(), input_data.inp_times.end());
-  env_temp.assign(input_data.inp_temp.begin(),input_data.inp_temp.end());
-  env_volumes.assign(input_data.inp_volumes.begin(),input_data.inp_volumes.end());
-  env_rho.assign(input_data.inp_rho.begin(), input_data.inp_rho.end());
-  env_pressure.assign(input_data.inp_pressure.begin(),input_data.inp_pressure.end());
-
-  cell_st.temperature = input_data.inp_shock_temp;
-  cell_st.rho      = env_rho[0];
-    
-  cell_st.volume_0      = env_volumes[0];
-  cell_st.volume        = env_volumes[0];
 
-  // return if there is only one initial time, otherwise continue and setup splines
-  if(input_data.inp_times.size()==1)
+  auto series = std::make_shared<env_series>();
+  series->times                  = std::move(input_data.inp_times);
+  series->values[ENV_TEMP]       = std::move(input_data.inp_temp);
+  series->values[ENV_VOLUME]     = std::move(input_data.inp_volumes);
+  series->values[ENV_RHO]        = std::move(input_data.inp_rho);
+  series->values[ENV_PRESSURE]   = std::move(input_data.inp_pressure);
+  if(series->times.empty())
   {
-    return;
+    PLOGE << "no environment data for cell " << cid;
+    exit(1);
   }
 
-  std::vector<double> times = env_times;
-  env_temp_interp = makima(std::move(times), std::move(env_temp));
-  std::vector<double> times1 = env_times;
-  env_volume_interp = makima(std::move(times1), std::move(env_volumes));
-  std::vector<double> times2 = env_times; 
-  env_rho_interp     = makima(std::move(times2), std::move(env_rho));
-  std::vector<double> times5 = env_times;
-  env_pressure_interp = makima(std::move(times5), std::move(env_pressure));
+  cell_st.rho      = series->values[ENV_RHO][0];
+  cell_st.volume_0 = series->values[ENV_VOLUME][0];
+  cell_st.volume   = series->values[ENV_VOLUME][0];
+  env = std::move(series);
+}
+
+// bytes held by this cell, including its buffers
+size_t
+cell::memory_bytes() const
+{
+  auto vec = [](const auto& v) { return v.capacity() * sizeof(v[0]); };
+  size_t n = sizeof(cell);
+  n += vec(reaction_switch) + vec(chem_reactions) + vec(dvdt_idx);
+  n += vec(active_nucleation) + vec(active_chemical);
+  n += vec(layout.grn_map) + vec(layout.state_map);
+  for (const auto* d: {&layout.dropped_state, &layout.dropped_vd, &layout.dropped_delSZ})
+    n += vec(d->idx) + vec(d->vals);
+  if (env) n += sizeof(env_series) + env->bytes();
+  n += env_interp.bytes();
+
+  n += vec(cell_st.init_abund) + vec(cell_st.cbars) + vec(cell_st.dadt) + vec(cell_st.Js);
+  n += vec(cell_st.ncrit) + vec(cell_st.S) + vec(cell_st.abund_moments_sizebins);
+  n += vec(cell_st.grn_sizes) + vec(cell_st.edges) + vec(cell_st.vd) + vec(cell_st.sizeBins);
+  n += vec(cell_st.runningTot_size_change) + vec(cell_st.rebin_chng);
+  n += vec(cell_st.parts);
+  for (const auto& p: cell_st.parts)
+  {
+    n += vec(p.r_nu) + vec(p.react_nu) + vec(p.react_idx);
+  }
+  return n;
 }
 
 // check there's no nans or negatives in the solution
@@ -158,10 +325,14 @@ cell::solve()
   auto abs_err = config->ode_abs_err, rel_err = config->ode_rel_err;
   double max_dt = config->ode_dt_max;// min_dt = config->ode_dt_min;
   double time_start, time_end;
-  if(!config->environment_file.empty() && env_times.size()!=1)
+  if(!config->environment_file.empty() && has_env_spline())
   {
-    time_start = env_times[0];
-    time_end = env_times.back();
+    if(env_interp.empty())
+    {
+      env_interp = env_interpolator(env);
+    }
+    time_start = env->times[0];
+    time_end = env->times.back();
     PLOGI << "Times taken from environment file.";
     PLOGI << "Start time: " << time_start << ", end time: " << time_end;
   }
@@ -171,6 +342,12 @@ cell::solve()
     time_end = cell_st.start_time + 3.14e7;
     PLOGI << "End Time is not specified, running simulation out for another year. End Time: " << time_end;
   }
+  bool resuming = !std::isnan(cell_st.resume_time);
+  if (resuming)
+  {
+    time_start = cell_st.resume_time;
+    PLOGI << "Cell " << cid << " continues from its restart file at " << time_start;
+  }
   auto dt0             = config->ode_dt_0;
   auto rkd             = runge_kutta_dopri5<std::vector<double>>{};
   auto stepper         = make_dense_output(abs_err, rel_err, max_dt, rkd);
@@ -183,8 +360,11 @@ cell::solve()
   cell_st.invkT = 1.0 / cell_st.kT;
   stepper.initialize(cell_st.abund_moments_sizebins, time_start, dt0);
   calc_state_vars(cell_st.abund_moments_sizebins, time_start);
-  CellObserver observer(cid,net,config);
-  observer.init_dump(cell_st);
+  CellObserver observer(cid,net,config,&layout);
+  if (resuming) observer.resume_dump(cell_st, cell_st.resume_mark);
+  else observer.init_dump(cell_st);
+  observer.skip_samples_before(time_start);
+  std::vector<double> sample_x;
   
   while ((stepper.current_time() < time_end)) {
     auto t0               = stepper.current_time();
@@ -205,8 +385,19 @@ cell::solve()
     } 
     else 
     {
-      observer(cell_st);
+      observer(cell_st, stepper.current_time(), stepper.current_state());
+      // reduction grid times inside the step, from the dense output
+      while (observer.next_sample_time() <= stepper.current_time()) {
+        sample_x.resize(stepper.current_state().size());
+        stepper.calc_state(observer.next_sample_time(), sample_x);
+        observer.add_sample(cell_st, volume_at(observer.next_sample_time()), sample_x);
+      }
       n_stepper_reset = 0;
+      if (stop_request::pending()) {
+        observer.checkpoint(cell_st, stepper.current_time(), stepper.current_state());
+        PLOGI << "stop requested, cell " << cid << " saved its restart file at t = " << stepper.current_time();
+        return;
+      }
     }
     if (n_solve_steps > CELL_MAX_STEPS) {
       PLOGI << "too many solve steps, exiting cell " << cid << " at t: " << stepper.current_time();
@@ -224,12 +415,13 @@ cell::solve()
     }
     if(n_solve_steps%RSN==0.0)
     {
-      observer.restart_dump(cell_st);
+      observer.restart_dump(cell_st, stepper.current_time(), stepper.current_state());
     }
     */
     ++n_solve_steps;
   }
   PLOGI << "done cell: " << cid;
+  observer.end_samples(cell_st, volume_at(stepper.current_time()), stepper.current_state());
   observer.finalSave(cell_st);
 }
 
@@ -237,14 +429,34 @@ cell::solve()
 void
 cell::check_reactions(const std::vector<double>& x)
 {
-  for (size_t i = 0; i < cell_st.numReact; ++i) {
-    reaction_switch[i] = true;
-    for (const auto& r_idx: net->reactants_idx[i]) {
+  bool changed = false;
+  auto check = [&](size_t reaction_idx) {
+    uint8_t on = 1;
+    for (const auto& r_idx: net->reactants_idx[reaction_idx]) {
       if (x[r_idx] < CELL_MINIMUM_ABUNDANCE) {
-        reaction_switch[i] = false;
+        on = 0;
         break;
       }
     }
+    changed |= (reaction_switch[reaction_idx] != on);
+    reaction_switch[reaction_idx] = on;
+  };
+  for (const auto& g: layout.grn_map) check(net->nucleation_reactions_idx[g]);
+  for (const auto& r: chem_reactions) check(r);
+  if (changed) update_active_reactions();
+}
+
+// rebuild the lists of switched on reactions the RHS loops over
+void
+cell::update_active_reactions()
+{
+  active_nucleation.clear();
+  for (size_t i = 0; i < cell_st.numReact; ++i) {
+    if (reaction_switch[net->nucleation_reactions_idx[layout.grn_map[i]]]) active_nucleation.push_back(i);
+  }
+  active_chemical.clear();
+  for (const auto& r: chem_reactions) {
+    if (reaction_switch[r]) active_chemical.push_back(r);
   }
 }
 
@@ -252,17 +464,20 @@ cell::check_reactions(const std::vector<double>& x)
 void
 cell::calc_state_vars(const std::vector<double>& x, const double time)
 {
+  START_BENCHMARK_TIMER("cell::calc_state_vars");
   using constants::k_B;
   using constants::kB_eV;
 
-  if(!config->environment_file.empty() && env_times.size()!=1)
+  if(!config->environment_file.empty() && has_env_spline())
   {
-    cell_st.temperature = env_temp_interp(time);
-    cell_st.volume   = env_volume_interp(time);
-    cell_st.rho      = env_rho_interp(time);
-    cell_st.drho     = env_rho_interp.prime(time);
-    cell_st.pressure = env_pressure_interp(time);
-    cell_st.dP       = env_pressure_interp.prime(time);
+    double env_vals[ENV_N_CHANNELS], env_derivs[ENV_N_CHANNELS];
+    env_interp(time, env_vals, env_derivs);
+    cell_st.temperature = env_vals[ENV_TEMP];
+    cell_st.volume   = env_vals[ENV_VOLUME];
+    cell_st.rho      = env_vals[ENV_RHO];
+    cell_st.drho     = env_derivs[ENV_RHO];
+    cell_st.pressure = env_vals[ENV_PRESSURE];
+    cell_st.dP       = env_derivs[ENV_PRESSURE];
   }
   
   cell_st.kT = k_B * cell_st.temperature; // ergs
@@ -271,8 +486,25 @@ cell::calc_state_vars(const std::vector<double>& x, const double time)
 
 }
 
+// the cell volume at time, from the interpolator if there is one
+double
+cell::volume_at(double time)
+{
+  if(config->environment_file.empty() || !has_env_spline()) return cell_st.volume;
+  double env_vals[ENV_N_CHANNELS], env_derivs[ENV_N_CHANNELS];
+  env_interp(time, env_vals, env_derivs);
+  return env_vals[ENV_VOLUME];
+}
+
 // solve ODEs for nucleation, grain growth, key species depeletion, etc.
 void cell::nucleate(const std::vector<double>& x)
+{
+  START_BENCHMARK_TIMER("cell::nucleate");
+  for_each_grain([&](size_t gidx) { nucleate_grain(x, gidx); });
+}
+
+// nucleation and growth of one grain species
+void cell::nucleate_grain(const std::vector<double>& x, size_t gidx)
 {
   using constants::amu2g;
   using constants::pi;
@@ -281,150 +513,153 @@ void cell::nucleate(const std::vector<double>& x)
   using constants::N_MOMENTS;
 
   int sd_start = cell_st.numGas + cell_st.numReact * N_MOMENTS;
-  for (size_t gidx = 0; gidx < cell_st.numReact; ++gidx) 
+  // finding key specie for reaction and identifying the reactants and their index
+  auto ngidx        = layout.grn_map[gidx];
+  auto reaction_idx = net->nucleation_reactions_idx[ngidx];
+  auto num_ks       = net->ks_lists_idx[ngidx].size();
+  auto key_spec_idx = net->ks_lists_idx[ngidx][0];
+  if (num_ks > 1) 
   {
-    // finding key specie for reaction and identifying the reactants and their index
-    auto reaction_idx = net->nucleation_reactions_idx[gidx];
-    auto num_ks       = net->ks_lists_idx[gidx].size();
-    auto key_spec_idx = net->ks_lists_idx[gidx][0];
-    if (num_ks > 1) 
+    for (size_t kidx = 0; kidx < num_ks; ++kidx) 
     {
-      for (size_t kidx = 0; kidx < num_ks; ++kidx) 
+      auto r_idx = net->ks_lists_idx[ngidx][kidx];
+      if (x[key_spec_idx] > x[r_idx])
       {
-        auto r_idx = net->ks_lists_idx[gidx][kidx];
-        if (x[key_spec_idx] > x[r_idx])
-        {
-          key_spec_idx = r_idx;
-        }
+        key_spec_idx = r_idx;
       }
     }
-    cell_st.parts[gidx].ks_idx = key_spec_idx;
-    // initializing and zeroing nuclation arrays
-    if (x[key_spec_idx] < CELL_MINIMUM_ABUNDANCE) 
-    {
-      cell_st.parts[gidx].is_nucleating = 0;
-      cell_st.S[gidx]                   = 0.0;
-      cell_st.Js[gidx]                  = 0.0;
-      cell_st.dadt[gidx]                = 0.0;
-      cell_st.ncrit[gidx]               = 0.0;
-      continue;
-    }
-    cell_st.parts[gidx].ks_react_mass =
-      elm.elements.at(net->species[cell_st.parts[gidx].ks_idx]).mass * amu2g;
-    std::vector<double> react_nu;
-    std::vector<int> react_idx;
-    // stoichiometry calculations for each reaction
-    auto stoich_ks = 0.0;
-    for (const auto& kv: net->nucleation_species_count[gidx]) 
-    {
-      if (kv.first == key_spec_idx) 
-      {
-        stoich_ks = kv.second;
-      }
-      react_idx.emplace_back(kv.first);
-    }
-    for (const auto& kv: net->nucleation_species_count[gidx])
-    {
-      react_nu.emplace_back(kv.second / stoich_ks);
-    }
-    cell_st.parts[gidx].react_idx = react_idx;
-    cell_st.parts[gidx].react_nu  = react_nu;
-    // nozawa et al. 2003 equ. 4, 2nd term r.h.s.
-    // term for saturation
-    double psum = 0.0;
-    for (size_t ridx = 0; ridx < react_idx.size(); ridx++) 
+  }
+  cell_st.parts[gidx].ks_idx = key_spec_idx;
+  // initializing and zeroing nuclation arrays
+  if (x[key_spec_idx] < CELL_MINIMUM_ABUNDANCE) 
+  {
+    cell_st.parts[gidx].is_nucleating = 0;
+    cell_st.S[gidx]                   = 0.0;
+    cell_st.Js[gidx]                  = 0.0;
+    cell_st.dadt[gidx]                = 0.0;
+    cell_st.ncrit[gidx]               = 0.0;
+    return;
+  }
+  if (net->species_mass[key_spec_idx] < 0.0)
+  {
+    PLOGE << "key species " << net->species[key_spec_idx] << " is not in the element table";
+    exit(1);
+  }
+  cell_st.parts[gidx].ks_react_mass = net->species_mass[key_spec_idx] * amu2g;
+  std::vector<double> react_nu;
+  std::vector<int> react_idx;
+  // stoichiometry calculations for each reaction
+  auto stoich_ks = 0.0;
+  for (const auto& kv: net->nucleation_species_count[ngidx]) 
+  {
+    if (kv.first == key_spec_idx) 
     {
-      if (x[react_idx[ridx]] != 0) 
-      {
-        if (react_idx[ridx] != cell_st.parts[gidx].ks_idx)
-        {
-          psum = psum + log(x[react_idx[ridx]] * cell_st.kT * istdP) * react_nu[ridx];
-        }
-      }
+      stoich_ks = kv.second;
     }
-    // updating concentrations
-    double c1 = x[key_spec_idx];
-    cell_st.cbars[gidx] = cell_st.init_abund[key_spec_idx] * cell_st.volume_0 / cell_st.volume;
-    // change in Gibbs free energy 
-    auto delg_reduced = (net->reactions[reaction_idx].alpha / cell_st.temperature -
-                          net->reactions[reaction_idx].beta) + psum;
-    // saturation
-    // nozawa et al. 2003 equ 4
-    cell_st.parts[gidx].lnS  = log(c1 * cell_st.kT * istdP) + delg_reduced;
-    // weights from reaction
-    double w = 1.0;
-    for (size_t ridx = 0; ridx < react_idx.size(); ++ridx) 
+    react_idx.emplace_back(kv.first);
+  }
+  for (const auto& kv: net->nucleation_species_count[ngidx])
+  {
+    react_nu.emplace_back(kv.second / stoich_ks);
+  }
+  cell_st.parts[gidx].react_idx = react_idx;
+  cell_st.parts[gidx].react_nu  = react_nu;
+  // nozawa et al. 2003 equ. 4, 2nd term r.h.s.
+  // term for saturation
+  double psum = 0.0;
+  for (size_t ridx = 0; ridx < react_idx.size(); ridx++) 
+  {
+    if (x[react_idx[ridx]] != 0) 
     {
       if (react_idx[ridx] != cell_st.parts[gidx].ks_idx)
       {
-        w = w + react_nu[ridx];
+        psum = psum + log(x[react_idx[ridx]] * cell_st.kT * istdP) * react_nu[ridx];
       }
     }
-    // function of partial gas presures
-    // yamamoto et al 2001 equ 16
-    double Pii = 1.0;
-    for (size_t ridx = 0; ridx < react_idx.size(); ++ridx) 
+  }
+  // updating concentrations
+  double c1 = x[key_spec_idx];
+  cell_st.cbars[gidx] = cell_st.init_abund[key_spec_idx] * cell_st.volume_0 / cell_st.volume;
+  // change in Gibbs free energy 
+  auto delg_reduced = (net->reactions[reaction_idx].alpha / cell_st.temperature -
+                        net->reactions[reaction_idx].beta) + psum;
+  // saturation
+  // nozawa et al. 2003 equ 4
+  cell_st.parts[gidx].lnS  = log(c1 * cell_st.kT * istdP) + delg_reduced;
+  // weights from reaction
+  double w = 1.0;
+  for (size_t ridx = 0; ridx < react_idx.size(); ++ridx) 
+  {
+    if (react_idx[ridx] != cell_st.parts[gidx].ks_idx)
     {
-      if (react_idx[ridx] != cell_st.parts[gidx].ks_idx)
-      {
-        Pii = Pii * std::pow(x[react_idx[ridx]] / c1, react_nu[ridx]);
-      }
+      w = w + react_nu[ridx];
     }
-    if (cell_st.parts[gidx].lnS > 0.0) 
+  }
+  // function of partial gas presures
+  // yamamoto et al 2001 equ 16
+  double Pii = 1.0;
+  for (size_t ridx = 0; ridx < react_idx.size(); ++ridx) 
+  {
+    if (react_idx[ridx] != cell_st.parts[gidx].ks_idx)
     {
-      double iw = 1. / w;
-      Pii       = std::pow(Pii, iw);
-      // nozawa et al. 2003 energy barrier for nucleation
-      double mu = 4.0 * pi * std::pow(net->reactions[reaction_idx].a_rad, 2.) *
-                  net->reactions[reaction_idx].sigma / cell_st.kT;
-      // nozawa et al. 2003 equ 3 term in exponential
-      double expJ = -4.0 / 27.0 * std::pow(mu, 3.) / std::pow(cell_st.parts[gidx].lnS, 2.);
-      // nozawa et al. 2003 equ 3 term in 1st square root r.h.s.
-      double Jkin = std::pow(2.0 * net->reactions[reaction_idx].sigma /
-                          (pi * cell_st.parts[gidx].ks_react_mass),0.5);
-      // saturation nozawa et all 2003 exponential of equ 4 
-      cell_st.S[gidx]    = exp(cell_st.parts[gidx].lnS);
-      // steady state nucleation rate nozawa et al. 2003 equ 3
-      cell_st.Js[gidx]   = net->reactions[reaction_idx].omega0 * Jkin * c1 * c1 * Pii * exp(expJ);
-      // growth rate, nozawa et al. 2003 equ 8
-      cell_st.dadt[gidx] = net->reactions[reaction_idx].omega0 *
-                      std::pow(0.5 * cell_st.kT / (pi * cell_st.parts[gidx].ks_react_mass), 0.5) *
-                      c1 * (1. - 1. / cell_st.S[gidx]);
-      // critical radius nozawa et al. 2003
-      cell_st.ncrit[gidx] = std::pow(2.0 / 3.0 * (mu / cell_st.parts[gidx].lnS), 3.0) + iw;
-      // finding growth from the dadt and storing it to determine if rebinning is needed
-      double growth = cell_st.dadt[gidx] * cell_st.dt;
-      for (int bidx = 0; bidx < cell_st.numBins; ++bidx)
-      {
-        auto idx = (gidx*cell_st.numBins)+bidx;
-        if(cell_st.abund_moments_sizebins[idx+sd_start]==0.0) continue;
-        cell_st.runningTot_size_change[idx] += growth;
-      }
-    } 
-    else 
-    { // we want to force these to zero in case a value is unchanged for
-      // the next timestep
-      cell_st.S[gidx]     = 0.0;
-      cell_st.Js[gidx]    = 0.0;
-      cell_st.dadt[gidx]  = 0.0;
-      cell_st.ncrit[gidx] = 0.0;
+      Pii = Pii * std::pow(x[react_idx[ridx]] / c1, react_nu[ridx]);
     }
-    if (cell_st.ncrit[gidx] > 0.0) 
-    {
-      cell_st.parts[gidx].grains_nucleating = cell_st.Js[gidx] * cell_st.ncrit[gidx];
-      cell_st.parts[gidx].is_nucleating     = 1;
-    } 
-    else 
+  }
+  if (cell_st.parts[gidx].lnS > 0.0) 
+  {
+    double iw = 1. / w;
+    Pii       = std::pow(Pii, iw);
+    // nozawa et al. 2003 energy barrier for nucleation
+    double mu = 4.0 * pi * std::pow(net->reactions[reaction_idx].a_rad, 2.) *
+                net->reactions[reaction_idx].sigma / cell_st.kT;
+    // nozawa et al. 2003 equ 3 term in exponential
+    double expJ = -4.0 / 27.0 * std::pow(mu, 3.) / std::pow(cell_st.parts[gidx].lnS, 2.);
+    // nozawa et al. 2003 equ 3 term in 1st square root r.h.s.
+    double Jkin = std::pow(2.0 * net->reactions[reaction_idx].sigma /
+                        (pi * cell_st.parts[gidx].ks_react_mass),0.5);
+    // saturation nozawa et all 2003 exponential of equ 4 
+    cell_st.S[gidx]    = exp(cell_st.parts[gidx].lnS);
+    // steady state nucleation rate nozawa et al. 2003 equ 3
+    cell_st.Js[gidx]   = net->reactions[reaction_idx].omega0 * Jkin * c1 * c1 * Pii * exp(expJ);
+    // growth rate, nozawa et al. 2003 equ 8
+    cell_st.dadt[gidx] = net->reactions[reaction_idx].omega0 *
+                    std::pow(0.5 * cell_st.kT / (pi * cell_st.parts[gidx].ks_react_mass), 0.5) *
+                    c1 * (1. - 1. / cell_st.S[gidx]);
+    // critical radius nozawa et al. 2003
+    cell_st.ncrit[gidx] = std::pow(2.0 / 3.0 * (mu / cell_st.parts[gidx].lnS), 3.0) + iw;
+    // finding growth from the dadt and storing it to determine if rebinning is needed
+    double growth = cell_st.dadt[gidx] * cell_st.dt;
+    for (int bidx = 0; bidx < cell_st.numBins; ++bidx)
     {
-      cell_st.parts[gidx].grains_nucleating = 0.0;
-      cell_st.parts[gidx].is_nucleating     = 0;
+      auto idx = (gidx*cell_st.numBins)+bidx;
+      if(cell_st.abund_moments_sizebins[idx+sd_start]==0.0) continue;
+      cell_st.runningTot_size_change[idx] += growth;
     }
+  } 
+  else 
+  { // we want to force these to zero in case a value is unchanged for
+    // the next timestep
+    cell_st.S[gidx]     = 0.0;
+    cell_st.Js[gidx]    = 0.0;
+    cell_st.dadt[gidx]  = 0.0;
+    cell_st.ncrit[gidx] = 0.0;
+  }
+  if (cell_st.ncrit[gidx] > 0.0) 
+  {
+    cell_st.parts[gidx].grains_nucleating = cell_st.Js[gidx] * cell_st.ncrit[gidx];
+    cell_st.parts[gidx].is_nucleating     = 1;
+  } 
+  else 
+  {
+    cell_st.parts[gidx].grains_nucleating = 0.0;
+    cell_st.parts[gidx].is_nucleating     = 0;
   }
 }
 
 // checking if a grain nucleates, finds the size and add it to the solution vector
 void cell::add_new_grn(const std::vector<double>& x)
 {
+  START_BENCHMARK_TIMER("cell::add_new_grn");
   using constants::N_MOMENTS;
   int sd_start = cell_st.numGas + cell_st.numReact * N_MOMENTS;
   for (int gidx = 0; gidx < cell_st.numReact; ++gidx) 
@@ -434,7 +669,7 @@ void cell::add_new_grn(const std::vector<double>& x)
       auto momIDX = cell_st.numGas + constants::N_MOMENTS * gidx;
       if ((x[momIDX + 3] > 0.0) && (x[momIDX + 0] > 0.0)) 
       {
-        auto reaction_idx = net->nucleation_reactions_idx[gidx];
+        auto reaction_idx = net->nucleation_reactions_idx[layout.grn_map[gidx]];
         // new grain size nozawa et al. 2003 equation 12
         double new_grn_size =
           (net->reactions[reaction_idx].a_rad) *
@@ -508,7 +743,7 @@ double cell::Therm(const int gidx, const int gsID)
 }
 
 // calculate the non-thermal sputtering rate
-double cell::NonTherm(const double& sidx, const int gidx, const int gsID)
+double cell::NonTherm(const int iid, const int gidx, const int gsID)
 {
     using constants::JtoEV;
     using constants::kB_eV;
@@ -517,7 +752,6 @@ double cell::NonTherm(const double& sidx, const int gidx, const int gsID)
     using constants::amu2Kg;
     using numbers::onehalf;
     using utilities::square;
-    int iid = gidx*cell_st.numBins+sidx;
     double x = onehalf * sputARR->miKG[gsID] * 
                 square(cell_st.vd[iid]*cm2m)*JtoEV; 
     double pref = sputARR->msp_2rhod[gidx] * cell_st.vd[iid] * cell_st.abund_moments_sizebins[gsID];
@@ -527,6 +761,13 @@ double cell::NonTherm(const double& sidx, const int gidx, const int gsID)
 
 // determin which sputtering occurs, clalculate it, store the erosion amount to determine if rebinning is needed.
 void cell::destroy()
+{
+  START_BENCHMARK_TIMER("cell::destroy");
+  for_each_grain([&](size_t gidx) { destroy_grain(gidx); });
+}
+
+// sputtering and slow down of every size bin of one grain species
+void cell::destroy_grain(size_t gidx)
 {
   using constants::pi;
   using constants::k_B;
@@ -542,43 +783,41 @@ void cell::destroy()
   using constants::N_MOMENTS;
   int sd_start = cell_st.numGas + cell_st.numReact * N_MOMENTS;
 
-  for ( auto gidx = 0; gidx < cell_st.numReact; ++gidx )
+  int ngidx = layout.grn_map[gidx];
+  for( int sidx =0; sidx < cell_st.numBins; ++sidx)
   {
-    for( int sidx =0; sidx < cell_st.numBins; ++sidx)
-    {
-        double dadt = 0.0;
-        int idx = (gidx*cell_st.numBins)+sidx;
-        // remember grain sizes are in cm
-        if(cell_st.abund_moments_sizebins[sd_start + idx] != 0.0)
-        {
-            for(auto gsID=0; gsID < cell_st.numGas; ++gsID)
-            {
-                if(cell_st.abund_moments_sizebins[gsID] == 0.0) continue;
-                // s_i2 is unitless, invkT is in cgs, vd is in cm/s
-                double s_i2 = sputARR->miGRAMS[gsID] * onehalf * cell_st.invkT * square(cell_st.vd[idx]);
-                // non-thermal sputtering occurrs
-                if( s_i2 > ten) 
-                {
-                    dadt +=  NonTherm(sidx+sd_start,gidx,gsID);
-                }
-                // thermal sputtering occurs
-                else 
-                {
-                    dadt += Therm(gidx,gsID);
-                }
-            }
-        }
-        cell_st.runningTot_size_change[idx] -= dadt*cell_st.dt;
-        // calculate the slow down of the shock and update
-        double temp_velo = calc_dvdt(cell_st.grn_sizes[sidx],cell_st.vd[idx],gidx) * cell_st.dt; // in cm/s
-        if(cell_st.vd[idx] - std::abs(temp_velo) >= 0.0)
-        {
-            cell_st.vd[idx] = cell_st.vd[idx] - std::abs(temp_velo);
-        }
-        else{
-            cell_st.vd[idx] = 0.0;
-        }
-    }
+      double dadt = 0.0;
+      int idx = (gidx*cell_st.numBins)+sidx;
+      // remember grain sizes are in cm
+      if(cell_st.abund_moments_sizebins[sd_start + idx] != 0.0)
+      {
+          for(auto gsID=0; gsID < cell_st.numGas; ++gsID)
+          {
+              if(cell_st.abund_moments_sizebins[gsID] == 0.0) continue;
+              // s_i2 is unitless, invkT is in cgs, vd is in cm/s
+              double s_i2 = sputARR->miGRAMS[gsID] * onehalf * cell_st.invkT * square(cell_st.vd[idx]);
+              // non-thermal sputtering occurrs
+              if( s_i2 > ten) 
+              {
+                  dadt +=  NonTherm(idx,ngidx,gsID);
+              }
+              // thermal sputtering occurs
+              else 
+              {
+                  dadt += Therm(ngidx,gsID);
+              }
+          }
+      }
+      cell_st.runningTot_size_change[idx] -= dadt*cell_st.dt;
+      // calculate the slow down of the shock and update
+      double temp_velo = calc_dvdt(cell_st.grn_sizes[sidx],cell_st.vd[idx],ngidx) * cell_st.dt; // in cm/s
+      if(cell_st.vd[idx] - std::abs(temp_velo) >= 0.0)
+      {
+          cell_st.vd[idx] = cell_st.vd[idx] - std::abs(temp_velo);
+      }
+      else{
+          cell_st.vd[idx] = 0.0;
+      }
   }
 }
 
@@ -593,17 +832,16 @@ double cell::calc_dvdt(const double& cross_sec, const double& vd, const int grni
     using numbers::ninePi_sixyfour;
     using utilities::square;
     using numbers::one;
-    using constants::N_MOMENTS;
-    int sd_start = cell_st.numGas + cell_st.numReact * N_MOMENTS;
 
     // nozawa et al 2006 equ 19
     double G_tot = 0;
     for(int gsID=0; gsID < cell_st.numGas; ++gsID)
     {
+        if(dvdt_idx[gsID] < 0) continue;
         // units of # of particles * mass in grams. might just need the mass not the * # of particles
         double m = sputARR->miGRAMS[gsID]; // should be in grams now
         double s2 = m * square(vd) / (2.*cell_st.kT); // assumes cgs units
-        G_tot += cell_st.abund_moments_sizebins[sd_start+gsID] * std::sqrt(s2) * eight_threeRootPi * 
+        G_tot += cell_st.abund_moments_sizebins[dvdt_idx[gsID]] * std::sqrt(s2) * eight_threeRootPi * 
                 std::sqrt(1.+s2*ninePi_sixyfour);
     }
     auto yield = sputARR->three_2Rhod[grnid] * cell_st.kT/(cross_sec)*G_tot;
@@ -613,6 +851,15 @@ double cell::calc_dvdt(const double& cross_sec, const double& vd, const int grni
 
 // rebin grains based on the growth and erosion totals
 void cell::rebin(const std::vector<double>& x, std::vector<double>& dxdt)
+{
+  START_BENCHMARK_TIMER("cell::rebin");
+  std::fill(cell_st.rebin_chng.begin(),cell_st.rebin_chng.end(),0.0);
+  // now we find which grains move up, which move down, and which stay the same
+  for_each_grain([&](size_t gidx) { rebin_grain(x, dxdt, gidx); });
+}
+
+// move the grains of one species whose size left their bin
+void cell::rebin_grain(const std::vector<double>& x, std::vector<double>& dxdt, size_t gidx)
 {
   using constants::kBeta;
   using constants::equPres;
@@ -625,58 +872,54 @@ void cell::rebin(const std::vector<double>& x, std::vector<double>& dxdt)
   using constants::N_MOMENTS;
   int sd_start = cell_st.numGas + cell_st.numReact * N_MOMENTS;
 
-  std::fill(cell_st.rebin_chng.begin(),cell_st.rebin_chng.end(),0.0);
-  // now we find which grains move up, which move down, and which stay the same
-  for ( auto gidx = 0; gidx < cell_st.numReact; ++gidx )
+  std::vector<double> binsMoveUp(cell_st.numBins,0.0);
+  std::vector<double> binsMoveDown(cell_st.numBins,0.0);
+  for (size_t bidx = 0; bidx < cell_st.numBins; ++bidx)
   {
-    std::vector<double> binsMoveUp(cell_st.numBins,0.0);
-    std::vector<double> binsMoveDown(cell_st.numBins,0.0);
-    for (size_t bidx = 0; bidx < cell_st.numBins; ++bidx)
+    auto idx = (gidx*cell_st.numBins)+bidx;
+    if (cell_st.abund_moments_sizebins[sd_start + idx]==0.0) continue;
+    // move down a bin
+    if(cell_st.grn_sizes[bidx]+cell_st.runningTot_size_change[idx] < cell_st.edges[bidx])
     {
-      auto idx = (gidx*cell_st.numBins)+bidx;
-      if (cell_st.abund_moments_sizebins[sd_start + idx]==0.0) continue;
-      // move down a bin
-      if(cell_st.grn_sizes[bidx]+cell_st.runningTot_size_change[idx] < cell_st.edges[bidx])
+      if(bidx==0)continue;
+      else
       {
-        if(bidx==0)continue;
-        else
-        {
-          double binWidth = cell_st.edges[bidx+1]-cell_st.edges[bidx];
-          double lowerBinWidth = cell_st.edges[bidx]-cell_st.edges[bidx-1];
-          binsMoveDown[bidx-1] = cell_st.abund_moments_sizebins[sd_start + idx]*(binWidth/lowerBinWidth);
-          cell_st.runningTot_size_change[idx] = 0.0;
-        }
-        cell_st.rebin_chng[bidx] -= 1.0;
-        cell_st.rebin_chng[bidx-1] += 1.0;
-      }
-      // move up a bin
-      if(cell_st.grn_sizes[bidx]+cell_st.runningTot_size_change[idx] > cell_st.edges[bidx+1])
-      {
-        if(bidx==cell_st.numBins-1) continue;
-        else
-        {
-          double binWidth = cell_st.edges[bidx+1]-cell_st.edges[bidx];
-          double higherBinWidth = cell_st.edges[bidx+2]-cell_st.edges[bidx+1];
-          binsMoveUp[bidx+1] = cell_st.abund_moments_sizebins[sd_start + idx]*(binWidth/higherBinWidth);
-          cell_st.runningTot_size_change[idx] = 0.0;
-        }
-        cell_st.rebin_chng[bidx] -= 1.0;
-        cell_st.rebin_chng[bidx+1] += 1.0;
+        double binWidth = cell_st.edges[bidx+1]-cell_st.edges[bidx];
+        double lowerBinWidth = cell_st.edges[bidx]-cell_st.edges[bidx-1];
+        binsMoveDown[bidx-1] = cell_st.abund_moments_sizebins[sd_start + idx]*(binWidth/lowerBinWidth);
+        cell_st.runningTot_size_change[idx] = 0.0;
       }
+      cell_st.rebin_chng[gidx*cell_st.numBins+bidx] -= 1.0;
+      cell_st.rebin_chng[gidx*cell_st.numBins+bidx-1] += 1.0;
     }
-    // now update the size bins
-    for (size_t bidx = 0; bidx < cell_st.numBins; ++bidx)
+    // move up a bin
+    if(cell_st.grn_sizes[bidx]+cell_st.runningTot_size_change[idx] > cell_st.edges[bidx+1])
     {
-      auto idx = (gidx*cell_st.numBins)+bidx;
-      dxdt[sd_start + idx] += binsMoveUp[bidx]+binsMoveDown[bidx];
+      if(bidx==cell_st.numBins-1) continue;
+      else
+      {
+        double binWidth = cell_st.edges[bidx+1]-cell_st.edges[bidx];
+        double higherBinWidth = cell_st.edges[bidx+2]-cell_st.edges[bidx+1];
+        binsMoveUp[bidx+1] = cell_st.abund_moments_sizebins[sd_start + idx]*(binWidth/higherBinWidth);
+        cell_st.runningTot_size_change[idx] = 0.0;
+      }
+      cell_st.rebin_chng[gidx*cell_st.numBins+bidx] -= 1.0;
+      cell_st.rebin_chng[gidx*cell_st.numBins+bidx+1] += 1.0;
     }
   }
+  // now update the size bins
+  for (size_t bidx = 0; bidx < cell_st.numBins; ++bidx)
+  {
+    auto idx = (gidx*cell_st.numBins)+bidx;
+    dxdt[sd_start + idx] += binsMoveUp[bidx]+binsMoveDown[bidx];
+  }
 }
 
 // called by integrator, updates x, dxdt, calls the relevant calculations
 void
 cell::operator()(const std::vector<double>& x, std::vector<double>& dxdt, const double t)
 {
+  START_BENCHMARK_TIMER("cell::operator()");
   using constants::N_MOMENTS;
   double fi;
   std::fill(std ::begin(dxdt), std ::end(dxdt), 0.0);
@@ -702,7 +945,7 @@ cell::operator()(const std::vector<double>& x, std::vector<double>& dxdt, const
       for (int j = 1; j < N_MOMENTS; ++j) {
         dxdt[gidx + j] =
           dxdt[gidx] * std::pow(cell_st.ncrit[i], (j / 3.0)) +
-          (j / net->reactions[i].a_rad) * cell_st.dadt[i] * x[gidx + j - 1];
+          (j / net->reactions[layout.grn_map[i]].a_rad) * cell_st.dadt[i] * x[gidx + j - 1];
       }
       for (size_t idx = 0; idx < cell_st.parts[i].react_idx.size(); ++idx) {
         auto r_idx = cell_st.parts[i].react_idx[idx];
@@ -714,20 +957,15 @@ cell::operator()(const std::vector<double>& x, std::vector<double>& dxdt, const
 
   for (size_t i = 0; i < cell_st.numGas; ++i)
     dxdt[i] += cell_st.drho / cell_st.rho * x[i];
-  for (size_t i = 0; i < cell_st.numReact; ++i) {
-    auto reaction_idx = net->nucleation_reactions_idx[i];
-    if (!reaction_switch[reaction_idx])
-      continue;
+  for (const auto& i: active_nucleation) {
+    auto reaction_idx = net->nucleation_reactions_idx[layout.grn_map[i]];
     for (const auto& r: net->reactants_idx[reaction_idx])
       dxdt[r] -= cell_st.parts[i].grains_nucleating;
     for (const auto& p: net->products_idx[reaction_idx])
       dxdt[p] += cell_st.parts[i].grains_nucleating;
   }
 
-  for (size_t i = 0; i < net->n_chemical_reactions; ++i) {
-    auto reaction_idx = net->chemical_reactions_idx[i];
-    if (!reaction_switch[reaction_idx])
-      continue;
+  for (const auto& reaction_idx: active_chemical) {
     fi = 1.0;
     for (const auto& r: net->reactants_idx[reaction_idx])
       fi *= x[r];
@@ -0,0 +1,514 @@
+/*© 2023. Triad National Security, LLC. All rights reserved.
+This program was produced under U.S. Government contract 89233218CNA000001 for Los Alamos
+National Laboratory (LANL), which is operated by Triad National Security, LLC for the U.S.
+Department of Energy/National Nuclear Security Administration. All rights in the program are.
+reserved by Triad National Security, LLC, and the U.S. Department of Energy/National Nuclear
+Security Administration. The Government is granted for itself and others acting on its behalf a
+nonexclusive, paid-up, irrevocable worldwide license in this material to reproduce, prepare.
+derivative works, distribute copies to the public, perform publicly and display publicly, and to permit.
+others to do so.*/
+
+
+#include "cell_container.h"
+
+#include "utilities.h"
+
+#include <plog/Log.h>
+
+#include <boost/filesystem.hpp>
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+cell_container* cell_container::active = nullptr;
+
+namespace
+{
+constexpr char     MAGIC[4]        = { 'N', 'U', 'D', 'C' };
+constexpr char     RECORD_MAGIC[4] = { 'N', 'U', 'D', 'c' };
+constexpr char     INDEX_MAGIC[4]  = { 'N', 'U', 'D', 'I' };
+constexpr uint32_t VERSION         = 1;
+constexpr uint32_t ORDER_PROBE     = 0x01020304;
+
+struct record_header
+{
+  char     magic[4];
+  uint32_t kind;
+  uint32_t cid;
+  uint32_t unused;
+  uint64_t length;
+};
+static_assert(sizeof(record_header) == 24, "record header must be packed");
+
+struct index_footer
+{
+  char     magic[4];
+  uint32_t unused;
+  uint64_t index_offset;
+  uint64_t n_cells;
+  uint64_t checksum;
+};
+static_assert(sizeof(index_footer) == 32, "index footer must be packed");
+
+void fail(const std::string& what)
+{
+  PLOGE << what << ": " << std::strerror(errno);
+  exit(1);
+}
+
+bool pwrite_all(int fd, const char* p, size_t n, uint64_t offset)
+{
+  while (n > 0)
+  {
+    auto w = ::pwrite(fd, p, n, offset);
+    if (w < 0)
+    {
+      if (errno == EINTR) continue;
+      return false;
+    }
+    p += w;
+    n -= w;
+    offset += w;
+  }
+  return true;
+}
+
+template<typename T>
+void put(std::string& buf, const T& v)
+{
+  buf.append(reinterpret_cast<const char*>(&v), sizeof(T));
+}
+
+template<typename T>
+T get(const char*& p)
+{
+  T v;
+  std::memcpy(&v, p, sizeof(T));
+  p += sizeof(T);
+  return v;
+}
+} // namespace
+
+cell_container::cell_container(const std::string& filename, bool writable, const std::string& stem,
+                               const std::string& ext)
+  : filename(filename), writable(writable), output_stem(stem), output_ext(ext)
+{
+  fd = ::open(filename.c_str(), writable ? O_RDWR | O_CREAT : O_RDONLY, 0644);
+  if (fd < 0) fail("Cannot open container " + filename);
+  struct stat st;
+  if (::fstat(fd, &st) != 0) fail("Cannot open container " + filename);
+
+  if (st.st_size == 0 && writable)
+  {
+    std::string head(MAGIC, sizeof(MAGIC));
+    put(head, VERSION);
+    put(head, ORDER_PROBE);
+    put(head, uint32_t(stem.size()));
+    head += stem;
+    put(head, uint32_t(ext.size()));
+    head += ext;
+    if (!pwrite_all(fd, head.data(), head.size(), 0)) fail("Cannot write container " + filename);
+    end = header_bytes = head.size();
+    return;
+  }
+  if (!read_header())
+  {
+    PLOGE << filename << " is not a cell container of this version and byte order";
+    exit(1);
+  }
+  if (writable && (output_stem != stem || output_ext != ext))
+  {
+    PLOGE << "container " << filename << " holds " << output_stem << "*" << output_ext << " cells, not "
+          << stem << "*" << ext;
+    exit(1);
+  }
+  uint64_t data_start = header_bytes = end;
+  if (!read_index())
+  {
+    PLOGW << "container " << filename << " has no index, rebuilding it from its records";
+    scan_records(data_start);
+  }
+  // new records go over the old index or a torn last record
+  if (writable && ::ftruncate(fd, end) != 0) fail("Cannot truncate container " + filename);
+}
+
+cell_container::~cell_container()
+{
+  if (writable && !compact()) write_index();
+  ::close(fd);
+}
+
+// superseded restart records and cut off output pile up in the log. when
+// they are more than half of it, the live records are copied to a new
+// container that replaces this one. true if that happened
+bool
+cell_container::compact()
+{
+  uint64_t live = header_bytes;
+  for (const auto& c: cells)
+  {
+    const auto& e = c.second;
+    live += e.output_length + e.chunks.size() * sizeof(record_header);
+    if (e.restart_length) live += e.restart_length + sizeof(record_header);
+    if (e.finished) live += sizeof(record_header);
+  }
+  if (live >= end || end - live <= live) return false;
+
+  PLOGI << "compacting container " << filename << " from " << end << " to " << live << " bytes";
+  auto tmpname = filename + ".tmp";
+  ::unlink(tmpname.c_str());
+  {
+    cell_container out(tmpname, true, output_stem, output_ext);
+    // the copy is synced once, when its index is written
+    out.sync_restarts = false;
+    std::string buf;
+    for (const auto& [cid, e]: cells)
+    {
+      for (const auto& ch: e.chunks)
+      {
+        buf.resize(ch.length);
+        if (!read_at(ch.offset, buf.data(), buf.size())) fail("Cannot read container " + filename);
+        out.append(output, cid, buf.data(), buf.size(), 0);
+      }
+      if (e.restart_length)
+      {
+        buf.resize(e.restart_length);
+        if (!read_at(e.restart_offset, buf.data(), buf.size())) fail("Cannot read container " + filename);
+        out.append(restart, cid, buf.data(), buf.size(), 0);
+      }
+      if (e.finished) out.append(finished, cid, nullptr, 0, 0);
+    }
+  }
+  if (::rename(tmpname.c_str(), filename.c_str()) != 0)
+  {
+    PLOGW << "cannot replace " << filename << " by its compacted copy: " << std::strerror(errno);
+    ::unlink(tmpname.c_str());
+    return false;
+  }
+  return true;
+}
+
+bool
+cell_container::read_at(uint64_t offset, char* p, uint64_t n) const
+{
+  while (n > 0)
+  {
+    auto r = ::pread(fd, p, n, offset);
+    if (r < 0 && errno == EINTR) continue;
+    if (r <= 0) return false;
+    p += r;
+    n -= r;
+    offset += r;
+  }
+  return true;
+}
+
+bool
+cell_container::read_header()
+{
+  char fixed[4 + 3 * sizeof(uint32_t)];
+  if (!read_at(0, fixed, sizeof(fixed)) || std::memcmp(fixed, MAGIC, sizeof(MAGIC)) != 0) return false;
+  const char* p = fixed + sizeof(MAGIC);
+  auto version  = get<uint32_t>(p);
+  auto probe    = get<uint32_t>(p);
+  auto n_stem   = get<uint32_t>(p);
+  if (version != VERSION || probe != ORDER_PROBE || n_stem > 4096) return false;
+  uint64_t pos = sizeof(fixed);
+  output_stem.resize(n_stem);
+  uint32_t n_ext;
+  if (!read_at(pos, output_stem.data(), n_stem) ||
+      !read_at(pos + n_stem, reinterpret_cast<char*>(&n_ext), sizeof(n_ext)) || n_ext > 4096)
+    return false;
+  pos += n_stem + sizeof(n_ext);
+  output_ext.resize(n_ext);
+  if (!read_at(pos, output_ext.data(), n_ext)) return false;
+  end = pos + n_ext;
+  return true;
+}
+
+bool
+cell_container::read_index()
+{
+  struct stat st;
+  if (::fstat(fd, &st) != 0) return false;
+  uint64_t size = st.st_size;
+  index_footer foot;
+  if (size < end + sizeof(foot) || !read_at(size - sizeof(foot), reinterpret_cast<char*>(&foot), sizeof(foot)) ||
+      std::memcmp(foot.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0 || foot.index_offset < end ||
+      foot.index_offset > size - sizeof(foot))
+    return false;
+
+  std::string buf(size - sizeof(foot) - foot.index_offset, '\0');
+  if (!read_at(foot.index_offset, buf.data(), buf.size()) ||
+      utilities::fnv1a(buf.data(), buf.size()) != foot.checksum)
+    return false;
+
+  const char* p       = buf.data();
+  const char* buf_end = p + buf.size();
+  constexpr size_t ENTRY_BYTES = 2 * sizeof(uint32_t) + 3 * sizeof(uint64_t);
+  for (uint64_t c = 0; c < foot.n_cells; ++c)
+  {
+    if (buf_end - p < static_cast<ptrdiff_t>(ENTRY_BYTES)) return false;
+    auto cid        = get<uint32_t>(p);
+    auto& e         = cells[cid];
+    e.finished      = get<uint32_t>(p) != 0;
+    e.restart_offset = get<uint64_t>(p);
+    e.restart_length = get<uint64_t>(p);
+    auto n_chunks   = get<uint64_t>(p);
+    if (static_cast<uint64_t>(buf_end - p) < n_chunks * sizeof(chunk)) return false;
+    e.chunks.resize(n_chunks);
+    for (auto& ch: e.chunks)
+    {
+      ch.offset = get<uint64_t>(p);
+      ch.length = get<uint64_t>(p);
+      e.output_length += ch.length;
+    }
+  }
+  end = foot.index_offset;
+  return true;
+}
+
+void
+cell_container::scan_records(uint64_t from)
+{
+  cells.clear();
+  struct stat st;
+  if (::fstat(fd, &st) != 0) fail("Cannot read container " + filename);
+  uint64_t size = st.st_size;
+  uint64_t pos  = from;
+  record_header rec;
+  while (pos + sizeof(rec) <= size && read_at(pos, reinterpret_cast<char*>(&rec), sizeof(rec)))
+  {
+    uint64_t payload = pos + sizeof(rec);
+    if (std::memcmp(rec.magic, RECORD_MAGIC, sizeof(RECORD_MAGIC)) != 0 || rec.length > size - payload) break;
+    uint64_t value = 0;
+    if (rec.kind == truncate &&
+        (rec.length != sizeof(value) || !read_at(payload, reinterpret_cast<char*>(&value), sizeof(value))))
+      break;
+    apply(rec.kind, rec.cid, payload, rec.length, value);
+    pos = payload + rec.length;
+  }
+  if (pos < size)
+  {
+    PLOGW << "container " << filename << ": dropping " << size - pos << " bytes after the last whole record";
+  }
+  end = pos;
+}
+
+void
+cell_container::apply(uint32_t kind, uint32_t cid, uint64_t offset, uint64_t length, uint64_t value)
+{
+  auto& e = cells[cid];
+  switch (kind)
+  {
+  case output:
+    e.chunks.push_back({ offset, length });
+    e.output_length += length;
+    break;
+  case truncate:
+    // cut whole chunks, then the last one, from the end
+    while (e.output_length > value && !e.chunks.empty())
+    {
+      auto& last  = e.chunks.back();
+      auto excess = e.output_length - value;
+      if (last.length <= excess)
+      {
+        e.output_length -= last.length;
+        e.chunks.pop_back();
+      }
+      else
+      {
+        last.length -= excess;
+        e.output_length = value;
+      }
+    }
+    e.finished = false;
+    break;
+  case restart:
+    e.restart_offset = offset;
+    e.restart_length = length;
+    break;
+  case finished:
+    e.finished       = true;
+    e.restart_length = 0;
+    break;
+  }
+}
+
+void
+cell_container::append(uint32_t kind, uint32_t cid, const char* payload, uint64_t length, uint64_t value)
+{
+  record_header rec;
+  std::memcpy(rec.magic, RECORD_MAGIC, sizeof(RECORD_MAGIC));
+  rec.kind   = kind;
+  rec.cid    = cid;
+  rec.unused = 0;
+  rec.length = length;
+
+  // only the space is taken under the lock; the write and the sync of a
+  // restart run concurrently with the other cells' records
+  uint64_t at;
+  {
+    std::lock_guard<std::mutex> g(lock);
+    at = end;
+    end += sizeof(rec) + length;
+  }
+  if (!pwrite_all(fd, reinterpret_cast<const char*>(&rec), sizeof(rec), at) ||
+      !pwrite_all(fd, payload, length, at + sizeof(rec)))
+    fail("Cannot write container " + filename);
+  if (kind == restart && sync_restarts && ::fdatasync(fd) != 0) fail("Cannot sync container " + filename);
+  std::lock_guard<std::mutex> g(lock);
+  apply(kind, cid, at + sizeof(rec), length, value);
+}
+
+void
+cell_container::write_index()
+{
+  std::lock_guard<std::mutex> g(lock);
+  std::string buf;
+  for (const auto& [cid, e]: cells)
+  {
+    put(buf, cid);
+    put(buf, uint32_t(e.finished));
+    put(buf, e.restart_offset);
+    put(buf, e.restart_length);
+    put(buf, uint64_t(e.chunks.size()));
+    for (const auto& ch: e.chunks)
+    {
+      put(buf, ch.offset);
+      put(buf, ch.length);
+    }
+  }
+  index_footer foot;
+  std::memcpy(foot.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+  foot.unused       = 0;
+  foot.index_offset = end;
+  foot.n_cells      = cells.size();
+  foot.checksum     = utilities::fnv1a(buf.data(), buf.size());
+  put(buf, foot);
+  if (!pwrite_all(fd, buf.data(), buf.size(), end) || ::fsync(fd) != 0)
+  {
+    PLOGW << "cannot write the index of container " << filename << ", it will be rebuilt on the next run";
+  }
+}
+
+void
+cell_container::append_output(uint32_t cid, const char* data, uint64_t n)
+{
+  if (n > 0) append(output, cid, data, n, 0);
+}
+
+void
+cell_container::truncate_output(uint32_t cid, uint64_t length)
+{
+  append(truncate, cid, reinterpret_cast<const char*>(&length), sizeof(length), length);
+}
+
+void
+cell_container::put_restart(uint32_t cid, const std::string& contents)
+{
+  append(restart, cid, contents.data(), contents.size(), 0);
+}
+
+void
+cell_container::finish_cell(uint32_t cid)
+{
+  append(finished, cid, nullptr, 0, 0);
+}
+
+bool
+cell_container::cell_finished(uint32_t cid)
+{
+  std::lock_guard<std::mutex> g(lock);
+  auto it = cells.find(cid);
+  return it != cells.end() && it->second.finished;
+}
+
+bool
+cell_container::has_restart(uint32_t cid)
+{
+  std::lock_guard<std::mutex> g(lock);
+  auto it = cells.find(cid);
+  return it != cells.end() && it->second.restart_length > 0;
+}
+
+uint64_t
+cell_container::output_length(uint32_t cid)
+{
+  std::lock_guard<std::mutex> g(lock);
+  auto it = cells.find(cid);
+  return it == cells.end() ? 0 : it->second.output_length;
+}
+
+bool
+cell_container::read_restart(uint32_t cid, std::string& contents)
+{
+  std::lock_guard<std::mutex> g(lock);
+  auto it = cells.find(cid);
+  if (it == cells.end() || it->second.restart_length == 0) return false;
+  contents.resize(it->second.restart_length);
+  return read_at(it->second.restart_offset, contents.data(), contents.size());
+}
+
+bool
+cell_container::read_output(uint32_t cid, std::string& contents)
+{
+  std::lock_guard<std::mutex> g(lock);
+  auto it = cells.find(cid);
+  if (it == cells.end()) return false;
+  contents.resize(it->second.output_length);
+  char* p = contents.data();
+  for (const auto& ch: it->second.chunks)
+  {
+    if (!read_at(ch.offset, p, ch.length)) return false;
+    p += ch.length;
+  }
+  return true;
+}
+
+std::vector<uint32_t>
+cell_container::cell_ids()
+{
+  std::lock_guard<std::mutex> g(lock);
+  std::vector<uint32_t> ids;
+  for (const auto& c: cells) ids.push_back(c.first);
+  return ids;
+}
+
+bool
+extract_container(const std::string& filename, const std::vector<uint32_t>& cids)
+{
+  cell_container box(filename, false);
+  auto dir = boost::filesystem::path(filename).parent_path();
+  auto ids = cids.empty() ? box.cell_ids() : cids;
+  bool ok  = true;
+  std::string contents;
+  for (auto cid: ids)
+  {
+    if (!box.read_output(cid, contents))
+    {
+      PLOGW << "container " << filename << " has no output for cell " << cid;
+      ok = false;
+      continue;
+    }
+    if (!box.cell_finished(cid))
+    {
+      PLOGW << "cell " << cid << " in " << filename << " is not finished";
+    }
+    auto out_name = (dir / (box.output_stem + std::to_string(cid) + box.output_ext)).string();
+    std::ofstream out(out_name, std::ios::binary | std::ios::trunc);
+    out.write(contents.data(), contents.size());
+    if (!out)
+    {
+      PLOGW << "cannot write " << out_name;
+      ok = false;
+      continue;
+    }
+    PLOGI << "extracted cell " << cid << " to " << out_name;
+  }
+  return ok;
+}
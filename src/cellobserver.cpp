@@ -12,16 +12,41 @@ others to do so.*/
 
 #include "network.h"
 #include "cell.h"
+#include "timer.h"
+#include "io_thread.h"
+#include "restart_file.h"
 
 #include <plog/Log.h>
+#include <cstdio>
+#include <cstring>
+#include <limits>
 #include <string>
 #include <vector>
 #include <sstream>
 #include <boost/filesystem.hpp>
 
+namespace
+{
+constexpr size_t OUTPUT_BUFFER_BYTES  = 1 << 20;
+constexpr size_t COMPRESS_BLOCK_BYTES = 256 * 1024; // raw records per compressed block
+
+// the text layout: every value through "%9e " (as boost::format did)
+// followed by a separator
+void append_values(std::string& line, const double* vals, size_t n, const char* fmt)
+{
+  char num[64];
+  for (size_t i = 0; i < n; ++i)
+  {
+    int len = std::snprintf(num, sizeof(num), fmt, vals[i]);
+    line.append(num, len);
+    line += ' ';
+  }
+}
+} // namespace
+
 // intialize the writer class and define output names
-CellObserver::CellObserver(std::size_t cid,const network* net, configuration* con)
-  : cid(cid)
+CellObserver::CellObserver(std::size_t cid,const network* net, configuration* con, const cell_layout* layout)
+  : cid(cid), layout(layout), ofs_buf(OUTPUT_BUFFER_BYTES)
 {
   num_nuc  = net->n_nucleation_reactions;
   num_spec = net->n_species;
@@ -29,8 +54,24 @@ CellObserver::CellObserver(std::size_t cid,const network* net, configuration* co
   modNum = con->mod_number; 
   m_nrestart = con->io_restart_n_steps;
   m_ndump = con->io_dump_n_steps;
-  ofname = "output/B"+std::to_string(numBins)+"_"+net->network_label +"_"+std::to_string(cid)+".dat";    
-  RSname = "restart/restart_B"+std::to_string(numBins)+"_"+net->network_label +"_"+std::to_string(cid)+".dat"; 
+  wall_interval = std::chrono::duration<double>(con->restart_wall_interval);
+  last_restart  = std::chrono::steady_clock::now();
+  if (con->async_io == 1) io = io_thread::active;
+  if (con->output_container == 1) container = cell_container::active;
+  write_output = con->cell_output == 1;
+  reducer      = cell_reductions::active;
+  has_volume   = !con->environment_file.empty();
+  this->net    = net;
+  kind = con->output_format == "binary"     ? output_kind::binary
+       : con->output_format == "compressed" ? output_kind::compressed
+       : con->output_format == "hdf5"       ? output_kind::hdf5
+                                            : output_kind::text;
+  ofname = "output/B"+std::to_string(numBins)+"_"+net->network_label +"_"+std::to_string(cid)
+         + output_extension(con->output_format);
+  RSname = "restart/restart_B"+std::to_string(numBins)+"_"+net->network_label +"_"+std::to_string(cid)+".rst";
+  done_name = "output/B"+std::to_string(numBins)+"_"+net->network_label +"_"+std::to_string(cid)+".done";
+  net_hash = net->source_hash;
+  block_rows = std::max<size_t>(16, COMPRESS_BLOCK_BYTES / (sizeof(double) * (layout->dropped_state.full_size + 1)));
 
   for(auto gn_id =0; gn_id < num_nuc; gn_id++)
   {
@@ -38,95 +79,451 @@ CellObserver::CellObserver(std::size_t cid,const network* net, configuration* co
   }  
 }
 
+// the solution in the full network layout. a cell that integrates every
+// grain already has that layout, so its state is used directly
+const std::vector<double>&
+CellObserver::full_solution(const std::vector<double>& x, std::vector<double>& scratch) const
+{
+  if (layout->dropped_state.idx.empty()) return x;
+  layout->expand_state(x, scratch);
+  return scratch;
+}
+
+void
+CellObserver::write_text(const std::vector<double>& vals, const char* fmt)
+{
+  std::string line;
+  line.reserve(vals.size() * 16);
+  append_values(line, vals.data(), vals.size(), fmt);
+  line += '\n';
+  put(line.data(), line.size());
+}
+
+void
+CellObserver::put(const char* p, size_t n)
+{
+  if (!container)
+  {
+    ofs.write(p, n);
+    return;
+  }
+  chunk.append(p, n);
+  if (chunk.size() >= OUTPUT_BUFFER_BYTES) flush_chunk();
+}
+
+void
+CellObserver::flush_chunk()
+{
+  container->append_output(cid, chunk.data(), chunk.size());
+  chunk.clear();
+}
+
+// start the cell's output from scratch
+void
+CellObserver::open_output(std::ios::openmode mode)
+{
+  if (container)
+  {
+    container->truncate_output(cid, 0);
+    chunk.reserve(OUTPUT_BUFFER_BYTES);
+    return;
+  }
+  ofs.rdbuf()->pubsetbuf(ofs_buf.data(), ofs_buf.size());
+  ofs.open(ofname, mode);
+}
+
 // dump initial data to the output file
 void CellObserver::init_dump(const cell_state& s)
 {
-    m_state = s;
-    ofs.open(ofname);
-    ofs << grnNames << "\n";
-
-    boost::format fmt ( "%1$14e " );
-    boost::format fmtL("%1$9e ");
+    if (!write_output) return;
+    const auto& x = full_solution(s.abund_moments_sizebins, full_x);
+#ifdef NUDUSTC_ENABLE_HDF5
+    if (kind == output_kind::hdf5)
+    {
+      using constants::N_MOMENTS;
+      size_t sections[3] = { layout->numGas, N_MOMENTS * layout->full_numReact, layout->full_numReact * layout->numBins };
+      h5 = std::make_unique<h5_cell_writer>(*h5_rank_file::active, cid, grnNames, s.grn_sizes, x, sections);
+      return;
+    }
+#endif
+    if (kind == output_kind::binary || kind == output_kind::compressed)
+    {
+      bool packed = kind == output_kind::compressed;
+      open_output(std::ios::binary | std::ios::trunc);
+      uint32_t head[] = { observer_header::VERSION, observer_header::ORDER_PROBE, num_nuc, numBins,
+                          static_cast<uint32_t>(s.grn_sizes.size()), static_cast<uint32_t>(x.size()),
+                          static_cast<uint32_t>(grnNames.size()) };
+      write_raw(packed ? observer_header::MAGIC_COMPRESSED : observer_header::MAGIC, sizeof(observer_header::MAGIC));
+      write_raw(head, sizeof(head));
+      write_raw(grnNames.data(), grnNames.size());
+      write_raw(s.grn_sizes.data(), s.grn_sizes.size() * sizeof(double));
+      write_raw(x.data(), x.size() * sizeof(double));
+      return;
+    }
+    open_output(std::ios::out);
+    put(grnNames.data(), grnNames.size());
+    put("\n", 1);
+    write_text(s.grn_sizes, "%14e ");
+    write_text(x, "%9e ");
+}
 
-    for(double &val: m_state.grn_sizes)
+// continue the output of a cell started from its restart file. whatever
+// was written after the restart point is cut off first
+void CellObserver::resume_dump(const cell_state& s, uint64_t mark)
+{
+    resumed = true;
+    if (!write_output) return;
+#ifdef NUDUSTC_ENABLE_HDF5
+    if (kind == output_kind::hdf5)
     {
-      ofs << fmt % val << " ";
+      using constants::N_MOMENTS;
+      const auto& x = full_solution(s.abund_moments_sizebins, full_x);
+      size_t sections[3] = { layout->numGas, N_MOMENTS * layout->full_numReact, layout->full_numReact * layout->numBins };
+      h5 = std::make_unique<h5_cell_writer>(*h5_rank_file::active, cid, grnNames, s.grn_sizes, x, sections, mark);
+      return;
     }
-    ofs << "\n";
-    for(double &val: m_state.abund_moments_sizebins)
+#endif
+    if (container)
     {
-      ofs << fmtL % val << " ";
+      if (mark == 0 || container->output_length(cid) < mark)
+      {
+        PLOGW << "output of cell " << cid << " does not reach the restart point, starting it over";
+        init_dump(s);
+        return;
+      }
+      container->truncate_output(cid, mark);
+      chunk.reserve(OUTPUT_BUFFER_BYTES);
+      return;
     }
-    ofs << "\n";
-    ofs.close();
+    boost::system::error_code ec;
+    auto size = boost::filesystem::file_size(ofname, ec);
+    if (ec || mark == 0 || size < mark)
+    {
+      PLOGW << ofname << " does not reach the restart point, starting it over";
+      init_dump(s);
+      return;
+    }
+    boost::filesystem::resize_file(ofname, mark);
+    ofs.rdbuf()->pubsetbuf(ofs_buf.data(), ofs_buf.size());
+    ofs.open(ofname, std::ios::binary | std::ios::app);
+    // so tellp() gives the file size before anything is appended
+    ofs.seekp(0, std::ios::end);
 }
 
 // write data to the output file
 void
 CellObserver::dump_data(const cell_state& s)
 {
-  m_state = s;
-  ofs.open(ofname, std::ofstream::app);
-  boost::format fmt("%1$5e ");
-  boost::format fmtL("%1$9e ");
+  if (!write_output) return;
+  if (!io)
+  {
+    write_record(s.time, full_solution(s.abund_moments_sizebins, full_x));
+    return;
+  }
+  auto& snap = take_slot();
+  snap.time = s.time;
+  const auto& x = full_solution(s.abund_moments_sizebins, snap.x);
+  if (&x != &snap.x) snap.x = x;
+  io->push([this, &snap] {
+    write_record(snap.time, snap.x);
+    release_slot(snap);
+  });
+}
 
-  ofs << fmtL % m_state.time << "\n";
-  for(double &val: m_state.abund_moments_sizebins)
-    ofs << fmtL % val << " ";
-  ofs << "\n";
+void
+CellObserver::write_record(double time, const std::vector<double>& x)
+{
+#ifdef NUDUSTC_ENABLE_HDF5
+  if (kind == output_kind::hdf5)
+  {
+    h5->append(time, x);
+    return;
+  }
+#endif
+  if (kind == output_kind::compressed)
+  {
+    pending.push_back(time);
+    pending.insert(pending.end(), x.begin(), x.end());
+    if (++pending_rows == block_rows) write_block();
+    return;
+  }
+  if (kind == output_kind::binary)
+  {
+    write_raw(&time, sizeof(double));
+    write_raw(x.data(), x.size() * sizeof(double));
+    return;
+  }
+  char num[64];
+  std::snprintf(num, sizeof(num), "%9e \n", time);
+  put(num, std::strlen(num));
+  write_text(x, "%9e ");
+}
 
-  ofs.close();
+void
+CellObserver::write_block()
+{
+  if (pending_rows == 0) return;
+  std::string block;
+  output_codec::encode_block(pending.data(), pending_rows, pending.size() / pending_rows, block);
+  put(block.data(), block.size());
+  pending.clear();
+  pending_rows = 0;
 }
 
 // create a restart file with current data
 void
-CellObserver::restart_dump(const cell_state& s)
+CellObserver::restart_dump(const cell_state& s, double time, const std::vector<double>& state)
 {
-    oRS.open(RSname);
-    boost::format fmt("%1$5e ");
-    boost::format fmtL("%1$9e ");
-    oRS << (m_state.time) << "\n";
+  last_restart = std::chrono::steady_clock::now();
+  if (!io)
+  {
+    layout->expand_bins(s.vd, layout->dropped_vd, full_vd);
+    layout->expand_bins(s.runningTot_size_change, layout->dropped_delSZ, full_delSZ);
+    write_restart(time, full_solution(state, full_x), full_vd, full_delSZ);
+    return;
+  }
+  auto& snap = take_slot();
+  snap.time = time;
+  const auto& x = full_solution(state, snap.x);
+  if (&x != &snap.x) snap.x = x;
+  layout->expand_bins(s.vd, layout->dropped_vd, snap.vd);
+  layout->expand_bins(s.runningTot_size_change, layout->dropped_delSZ, snap.delSZ);
+  io->push([this, &snap] {
+    write_restart(snap.time, snap.x, snap.vd, snap.delSZ);
+    release_slot(snap);
+  });
+}
 
-    for(int idx = 0; idx < m_state.vd.size(); idx ++)
+void
+CellObserver::write_restart(double time, const std::vector<double>& x, const std::vector<double>& vd,
+                            const std::vector<double>& delSZ)
+{
+    // everything dumped so far is on disk before the restart file points
+    // past it
+    // without cell output there is nothing to cut back to
+    uint64_t mark = 0;
+#ifdef NUDUSTC_ENABLE_HDF5
+    if (h5)
     {
-        oRS << fmt % (m_state.vd[idx]) << " ";
+      h5->sync();
+      mark = h5->n_rows();
     }
-    oRS << "\n";
-
-    for(int idx = 0; idx < m_state.runningTot_size_change.size(); idx ++)
+    else
+#endif
+    if (write_output)
     {
-        oRS << fmt % (m_state.runningTot_size_change[idx]) << " ";
+      write_block();
+      if (container)
+      {
+        flush_chunk();
+        mark = container->output_length(cid);
+      }
+      else
+      {
+        ofs.flush();
+        mark = static_cast<uint64_t>(ofs.tellp());
+      }
     }
-    oRS << "\n";
-    // solution vector
-    for(int idx = 0; idx < m_state.abund_moments_sizebins.size(); idx ++)
+    if (container)
     {
-        oRS << fmt % (m_state.abund_moments_sizebins[idx]) << " ";
+      restart_file::encode(net_hash, time, mark, vd, delSZ, x, rs_buf);
+      container->put_restart(cid, rs_buf);
+      return;
     }
-    oRS << "\n";
+    restart_file::write(RSname, net_hash, time, mark, vd, delSZ, x, rs_buf);
+}
+
+// a free snapshot buffer, waiting while both are still being written
+CellObserver::snapshot&
+CellObserver::take_slot()
+{
+  std::unique_lock<std::mutex> g(slot_lock);
+  auto& snap = slots[next_slot];
+  slot_free.wait(g, [&] { return !snap.busy; });
+  snap.busy = true;
+  next_slot ^= 1;
+  return snap;
+}
 
-    oRS.close();
+// notified under the lock: the observer may be destroyed as soon as
+// its owner sees the slot free
+void
+CellObserver::release_slot(snapshot& snap)
+{
+  std::lock_guard<std::mutex> g(slot_lock);
+  snap.busy = false;
+  slot_free.notify_all();
+}
+
+// wait until the io thread has written every queued snapshot
+void
+CellObserver::wait_written()
+{
+  std::unique_lock<std::mutex> g(slot_lock);
+  slot_free.wait(g, [&] { return !slots[0].busy && !slots[1].busy; });
 }
 
 // call to class, if user specified, write to file or restart file
 void
-CellObserver::operator()(const cell_state& s)
+CellObserver::operator()(const cell_state& s, double time, const std::vector<double>& state)
 {
+  START_BENCHMARK_TIMER("CellObserver::operator()");
   ++n_called;
   if (n_called % m_ndump == 0) {
-    m_state = s;
     dump_data(s);
   }
-  if (n_called % m_nrestart == 0) {
-    m_state = s;
-    restart_dump(s);
+  if (n_called % m_nrestart == 0 ||
+      (wall_interval.count() > 0 && std::chrono::steady_clock::now() - last_restart >= wall_interval)) {
+    restart_dump(s, time, state);
   }
 }
 
 // final writing of data at the end of inregartion
 void CellObserver::finalSave (const cell_state& s)
 {   
-  m_state = s;
   dump_data(s);
+  if (io) wait_written();
+  write_block();
+  if (container)
+  {
+    flush_chunk();
+    container->finish_cell(cid);
+    return;
+  }
+  ofs.close();
+#ifdef NUDUSTC_ENABLE_HDF5
+  if (h5) h5->finish();
+#endif
+  if (!write_output) std::ofstream(done_name).close();
   boost::filesystem::remove(RSname);
 }
+
+double
+CellObserver::next_sample_time() const
+{
+  if (!reducer || next_sample >= reducer->times.size()) return std::numeric_limits<double>::infinity();
+  return reducer->times[next_sample];
+}
+
+void
+CellObserver::skip_samples_before(double t)
+{
+  while (next_sample_time() < t) ++next_sample;
+}
+
+// dust mass of each grain from its third moment (the fraction of the key
+// species in dust) and the dust volume in each size bin. masses count the
+// reactants with an element mass; without an environment file there is
+// no cell volume and the values are per cm^3. everything is taken at the
+// time of x: the key species and its concentration are worked out as in
+// cell::nucleate_grain, not read from the last right hand side call
+void
+CellObserver::compute_sample(const cell_state& s, double volume, const std::vector<double>& x)
+{
+  using constants::N_MOMENTS;
+  using constants::amu2g;
+  using constants::pi;
+
+  const auto& full = full_solution(x, sample_full);
+  size_t n_g      = reducer->n_grains();
+  size_t n_b      = reducer->n_bins();
+  size_t sd_start = layout->numGas + N_MOMENTS * layout->full_numReact;
+  double scale    = has_volume ? volume : 1.0;
+  smp.mass.assign(n_g, 0.0);
+  smp.sd_volume.assign(n_g * n_b, 0.0);
+
+  for (auto g: layout->grn_map)
+  {
+    if (g >= n_g) continue;
+    const auto& ks_list = net->ks_lists_idx[g];
+    auto key_spec_idx   = ks_list[0];
+    for (auto r_idx: ks_list)
+      if (full[key_spec_idx] > full[r_idx]) key_spec_idx = r_idx;
+    const auto& counts = net->nucleation_species_count[g];
+    auto ks            = counts.find(key_spec_idx);
+    if (ks == counts.end() || ks->second == 0) continue;
+    double m_mono = 0.0;
+    for (const auto& kv: counts)
+    {
+      auto m = net->species_mass[kv.first];
+      if (m > 0.0) m_mono += double(kv.second) / ks->second * m * amu2g;
+    }
+    double cbar = s.init_abund[key_spec_idx] * s.volume_0 / volume;
+    smp.mass[g] = cbar * full[layout->numGas + g * N_MOMENTS + 3] * m_mono * scale;
+  }
+  for (size_t g = 0; g < std::min(n_g, layout->full_numReact); ++g)
+  {
+    for (size_t b = 0; b < std::min(n_b, s.grn_sizes.size()); ++b)
+    {
+      double a = s.grn_sizes[b];
+      smp.sd_volume[g * n_b + b] = full[sd_start + g * layout->numBins + b] * 4.0 / 3.0 * pi * a * a * a * scale;
+    }
+  }
+}
+
+void
+CellObserver::add_sample(const cell_state& s, double volume, const std::vector<double>& x)
+{
+  START_BENCHMARK_TIMER("CellObserver::add_sample");
+  compute_sample(s, volume, x);
+  reducer->add(next_sample++, smp);
+}
+
+void
+CellObserver::end_samples(const cell_state& s, double volume, const std::vector<double>& x)
+{
+  if (!reducer) return;
+  using constants::N_MOMENTS;
+  compute_sample(s, volume, x);
+  for (; next_sample < reducer->times.size(); ++next_sample) reducer->add(next_sample, smp);
+
+  const auto& full = full_solution(x, sample_full);
+  std::vector<double> efficiency(reducer->n_grains(), 0.0);
+  for (size_t g = 0; g < std::min(efficiency.size(), layout->full_numReact); ++g)
+    efficiency[g] = full[layout->numGas + g * N_MOMENTS + 3];
+  reducer->add_final(cid, efficiency, resumed);
+}
+
+// write a restart file for s and wait until it is on disk. the output is
+// left unfinished, so the next run continues the cell from here
+void CellObserver::checkpoint(const cell_state& s, double time, const std::vector<double>& state)
+{
+  restart_dump(s, time, state);
+  if (io) wait_written();
+}
+
+std::string
+output_extension(const std::string& format)
+{
+  if (format == "binary") return ".bin";
+  if (format == "compressed") return ".nuz";
+  return ".dat";
+}
+
+bool
+export_observer_text(const std::string& bin_file, const std::string& text_file)
+{
+  output_reader in;
+  if (!in.open(bin_file)) return false;
+
+  std::ofstream out(text_file);
+  std::string line = in.header.grain_names + "\n";
+  append_values(line, in.grain_sizes.data(), in.grain_sizes.size(), "%14e ");
+  line += '\n';
+  append_values(line, in.initial.data(), in.initial.size(), "%9e ");
+  line += '\n';
+  out << line;
+  // a record cut short by an interrupted run is dropped
+  double time;
+  std::vector<double> vals;
+  while (in.next(time, vals))
+  {
+    char num[64];
+    std::snprintf(num, sizeof(num), "%9e \n", time);
+    line = num;
+    append_values(line, vals.data(), vals.size(), "%9e ");
+    line += '\n';
+    out << line;
+  }
+  return true;
+}
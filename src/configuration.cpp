@@ -30,8 +30,11 @@ configuration::configuration() : desc ( "configuration" )
     desc.add_options() ( "sizeDist_file", options::value<std::string> ( &sizeDist_file ), "file with size distributions" );
     desc.add_options() ( "environment_file",options::value<std::string>(&environment_file),"file with stellar environment variables");
     desc.add_options() ( "network_file", options::value<std::string> ( &network_file ), "file with network" );
+    desc.add_options() ( "use_network_cache", options::value<int> ( &use_network_cache )->default_value (0), "keep a compiled copy of the network file (.nnet) and reuse it" );
     desc.add_options() ( "abundance_file", options::value<std::string> ( &abundance_file ), "file with inital abundances" );
     desc.add_options() ( "shock_file", options::value<std::string> ( &shock_file ), "file with inital shock parameters per cell" );
+    desc.add_options() ( "parse_threads", options::value<int> ( &parse_threads )->default_value (0), "threads used to parse the text input files (0: one per core)" );
+    desc.add_options() ( "input_bundle", options::value<std::string> ( &input_bundle ), "binary bundle of the input files written by --pack" );
 
     // describe dust size distribution for binning
     desc.add_options() ( "size_dist_min_rad_exponent_cm", options::value<double> ( &low_sd_exp )->default_value ( NAN ), "exponent for the min radius of the size dist. in cm" );
@@ -43,7 +46,20 @@ configuration::configuration() : desc ( "configuration" )
     desc.add_options() ( "do_nucleation", options::value<int> ( &do_nucleation )->default_value (0), "do nucleation calculations" );
 
     // print out and save to file controls
+    desc.add_options() ( "n_threads", options::value<int> ( &n_threads )->default_value (0), "threads integrating cells (0: the cores of the node shared among its ranks)" );
+    desc.add_options() ( "intra_cell_parallel", options::value<int> ( &intra_cell_parallel )->default_value (0), "let idle threads help with the grain loops of a cell" );
+    desc.add_options() ( "output_format", options::value<std::string> ( &output_format )->default_value ("text"), "cell output files: text or binary" );
+    desc.add_options() ( "async_io", options::value<int> ( &async_io )->default_value (0), "write cell output from a background thread" );
+    desc.add_options() ( "output_container", options::value<int> ( &output_container )->default_value (0), "write cell output and restart files into one container file per rank" );
+    desc.add_options() ( "cell_output", options::value<int> ( &cell_output )->default_value (1), "write the per-cell output (0: only restart files and reductions)" );
+    desc.add_options() ( "reduce_n_times", options::value<int> ( &reduce_n_times )->default_value (0), "times on the grid of the in-situ reductions (0: off)" );
+    desc.add_options() ( "reduce_t_min", options::value<double> ( &reduce_t_min )->default_value (0), "first time of the reduction grid (s)" );
+    desc.add_options() ( "reduce_t_max", options::value<double> ( &reduce_t_max )->default_value (0), "last time of the reduction grid (s)" );
+    desc.add_options() ( "cell_distribution", options::value<std::string> ( &cell_distribution )->default_value ("block"), "how cells are split between MPI ranks: block or dynamic" );
+    desc.add_options() ( "cell_batch", options::value<int> ( &cell_batch )->default_value (1), "cells taken at a time in dynamic distribution" );
+    desc.add_options() ( "lazy_cells", options::value<int> ( &lazy_cells )->default_value (0), "build each cell just before it is solved and free it afterwards" );
     desc.add_options() ( "io_restart_n_steps",options::value<int>(&io_restart_n_steps)->default_value(1000),"write restart file to disk every n steps");
+    desc.add_options() ( "restart_wall_interval",options::value<double>(&restart_wall_interval)->default_value(0),"also write the restart file when this many seconds have passed since the last one (0: off)");
     desc.add_options() ( "io_dump_n_steps",options::value<int>(&io_dump_n_steps)->default_value(1000), "write dump file to disk  every n steps");
     
 
@@ -0,0 +1,291 @@
+/*© 2023. Triad National Security, LLC. All rights reserved.
+This program was produced under U.S. Government contract 89233218CNA000001 for Los Alamos
+National Laboratory (LANL), which is operated by Triad National Security, LLC for the U.S.
+Department of Energy/National Nuclear Security Administration. All rights in the program are.
+reserved by Triad National Security, LLC, and the U.S. Department of Energy/National Nuclear
+Security Administration. The Government is granted for itself and others acting on its behalf a
+nonexclusive, paid-up, irrevocable worldwide license in this material to reproduce, prepare.
+derivative works, distribute copies to the public, perform publicly and display publicly, and to permit.
+others to do so.*/
+
+#include "h5_output.h"
+
+#include <plog/Log.h>
+
+#include <boost/filesystem.hpp>
+
+#include <algorithm>
+
+std::mutex    h5_rank_file::lock;
+h5_rank_file* h5_rank_file::active = nullptr;
+
+namespace
+{
+// aim for chunks of about this many bytes in the widest dataset
+constexpr size_t CHUNK_BYTES = 256 * 1024;
+
+std::string group_name(uint32_t cid) { return "cell_" + std::to_string(cid); }
+
+void fail(const std::string& what, const H5::Exception& e)
+{
+  PLOGE << what << ": " << e.getDetailMsg();
+  exit(1);
+}
+
+void write_attribute(H5::Group& g, const std::string& name, const std::string& value)
+{
+  H5::StrType type(H5::PredType::C_S1, std::max<size_t>(1, value.size()));
+  auto attr = g.createAttribute(name, type, H5::DataSpace(H5S_SCALAR));
+  attr.write(type, value);
+}
+
+void write_vector(H5::Group& g, const std::string& name, const std::vector<double>& v)
+{
+  hsize_t dims[1] = { v.size() };
+  auto ds = g.createDataSet(name, H5::PredType::NATIVE_DOUBLE, H5::DataSpace(1, dims));
+  if (!v.empty()) ds.write(v.data(), H5::PredType::NATIVE_DOUBLE);
+}
+
+H5::DataSet create_extendible(H5::Group& g, const std::string& name, size_t width, size_t chunk_rows)
+{
+  int rank = width ? 2 : 1;
+  hsize_t dims[2]    = { 0, width };
+  hsize_t maxdims[2] = { H5S_UNLIMITED, width };
+  hsize_t chunk[2]   = { chunk_rows, width };
+  H5::DSetCreatPropList props;
+  props.setChunk(rank, chunk);
+  return g.createDataSet(name, H5::PredType::NATIVE_DOUBLE, H5::DataSpace(rank, dims, maxdims), props);
+}
+
+// write rows [0, n) of a row major block, cols [offset, offset+width)
+// of each, after the first `start` rows of ds
+void append_block(H5::DataSet& ds, const double* block, size_t n, size_t row_len, size_t offset,
+                  size_t width, size_t start)
+{
+  int rank = width ? 2 : 1;
+  hsize_t new_dims[2] = { start + n, width };
+  ds.extend(new_dims);
+  H5::DataSpace file_space = ds.getSpace();
+  hsize_t count[2]  = { n, width };
+  hsize_t origin[2] = { start, 0 };
+  file_space.selectHyperslab(H5S_SELECT_SET, count, origin);
+  // the memory side picks the columns out of the full rows
+  hsize_t mem_dims[2]  = { n, row_len };
+  hsize_t mem_start[2] = { 0, offset };
+  H5::DataSpace mem_space(rank, width ? mem_dims : count);
+  if (width) mem_space.selectHyperslab(H5S_SELECT_SET, count, mem_start);
+  ds.write(block, H5::PredType::NATIVE_DOUBLE, mem_space, file_space);
+}
+} // namespace
+
+h5_rank_file::h5_rank_file(const std::string& filename)
+{
+  std::lock_guard<std::mutex> g(lock);
+  H5::Exception::dontPrint();
+  try
+  {
+    if (boost::filesystem::exists(filename))
+    {
+      try
+      {
+        file.openFile(filename, H5F_ACC_RDWR);
+        return;
+      }
+      catch (const H5::Exception& e)
+      {
+        PLOGW << "Cannot open HDF5 output " << filename << " (" << e.getDetailMsg()
+              << "), moving it to " << filename << ".bad and starting a new file";
+        boost::filesystem::rename(filename, filename + ".bad");
+      }
+    }
+    file = H5::H5File(filename, H5F_ACC_TRUNC);
+  }
+  catch (const H5::Exception& e)
+  {
+    fail("Cannot open HDF5 output " + filename, e);
+  }
+}
+
+h5_rank_file::~h5_rank_file()
+{
+  std::lock_guard<std::mutex> g(lock);
+  file.close();
+}
+
+bool
+h5_rank_file::cell_finished(uint32_t cid)
+{
+  std::lock_guard<std::mutex> g(lock);
+  auto name = group_name(cid);
+  if (H5Lexists(file.getId(), name.c_str(), H5P_DEFAULT) <= 0) return false;
+  return file.openGroup(name).attrExists("finished");
+}
+
+size_t
+h5_rank_file::cell_rows(uint32_t cid)
+{
+  std::lock_guard<std::mutex> g(lock);
+  auto name = group_name(cid) + "/time";
+  if (H5Lexists(file.getId(), group_name(cid).c_str(), H5P_DEFAULT) <= 0 ||
+      H5Lexists(file.getId(), name.c_str(), H5P_DEFAULT) <= 0)
+    return 0;
+  hsize_t dims[1];
+  file.openDataSet(name).getSpace().getSimpleExtentDims(dims);
+  return dims[0];
+}
+
+h5_cell_writer::h5_cell_writer(h5_rank_file& out, uint32_t cid, const std::string& grain_names,
+                               const std::vector<double>& grain_sizes, const std::vector<double>& initial,
+                               const size_t (&sections)[3], size_t resume_rows)
+  : n_values(initial.size())
+{
+  chunk_rows = std::max<size_t>(16, CHUNK_BYTES / (sizeof(double) * std::max<size_t>(1, n_values)));
+  times.reserve(chunk_rows);
+  rows.reserve(chunk_rows * n_values);
+
+  std::lock_guard<std::mutex> g(h5_rank_file::lock);
+  try
+  {
+    auto name = group_name(cid);
+    bool exists = H5Lexists(out.file.getId(), name.c_str(), H5P_DEFAULT) > 0;
+    if (exists && resume_rows > 0)
+    {
+      group = out.file.openGroup(name);
+      if (reopen(resume_rows)) return;
+      PLOGW << "HDF5 output of cell " << cid << " does not reach the restart point, starting it over";
+      sets.clear();
+      group.close();
+    }
+    // a group left by an interrupted run is started over
+    if (exists) out.file.unlink(name);
+    group = out.file.createGroup(name);
+    write_attribute(group, "grain_names", grain_names);
+    write_vector(group, "grain_sizes", grain_sizes);
+    write_vector(group, "initial_state", initial);
+
+    time_ds = create_extendible(group, "time", 0, chunk_rows);
+    const char* names[] = { "gas", "moments", "size_bins" };
+    size_t offset = 0;
+    for (int s = 0; s < 3 && offset < n_values; ++s)
+    {
+      size_t width = std::min(sections[s], n_values - offset);
+      if (width) sets.push_back({ offset, width, create_extendible(group, names[s], width, chunk_rows) });
+      offset += width;
+    }
+    if (offset < n_values)
+    {
+      sets.push_back({ offset, n_values - offset, create_extendible(group, "extra", n_values - offset, chunk_rows) });
+    }
+  }
+  catch (const H5::Exception& e)
+  {
+    fail("Cannot create HDF5 output for cell " + std::to_string(cid), e);
+  }
+}
+
+// open the datasets of an existing group and cut them to n rows
+bool
+h5_cell_writer::reopen(size_t n)
+{
+  const char* names[] = { "gas", "moments", "size_bins", "extra" };
+  time_ds = group.openDataSet("time");
+  size_t offset = 0;
+  for (auto name: names)
+  {
+    if (H5Lexists(group.getId(), name, H5P_DEFAULT) <= 0) continue;
+    auto ds = group.openDataSet(name);
+    hsize_t dims[2];
+    ds.getSpace().getSimpleExtentDims(dims);
+    if (dims[0] < n) return false;
+    sets.push_back({ offset, dims[1], ds });
+    offset += dims[1];
+  }
+  hsize_t dims[1];
+  time_ds.getSpace().getSimpleExtentDims(dims);
+  if (offset != n_values || dims[0] < n) return false;
+
+  hsize_t rows[1] = { n };
+  time_ds.extend(rows);
+  for (auto& s: sets)
+  {
+    hsize_t extent[2] = { n, s.width };
+    s.ds.extend(extent);
+  }
+  rows_written = n;
+  return true;
+}
+
+h5_cell_writer::~h5_cell_writer()
+{
+  flush();
+  // HDF5 handles must be closed under the lock too
+  std::lock_guard<std::mutex> g(h5_rank_file::lock);
+  for (auto& s: sets) s.ds.close();
+  time_ds.close();
+  group.close();
+}
+
+void
+h5_cell_writer::append(double time, const std::vector<double>& x)
+{
+  times.push_back(time);
+  rows.insert(rows.end(), x.begin(), x.begin() + std::min(n_values, x.size()));
+  rows.resize(times.size() * n_values);
+  if (times.size() >= chunk_rows) flush();
+}
+
+void
+h5_cell_writer::flush()
+{
+  if (times.empty()) return;
+  std::lock_guard<std::mutex> g(h5_rank_file::lock);
+  write_rows();
+}
+
+void
+h5_cell_writer::sync()
+{
+  std::lock_guard<std::mutex> g(h5_rank_file::lock);
+  if (!times.empty()) write_rows();
+  if (H5Fflush(group.getId(), H5F_SCOPE_LOCAL) < 0)
+  {
+    PLOGE << "Cannot flush HDF5 output";
+    exit(1);
+  }
+}
+
+void
+h5_cell_writer::write_rows()
+{
+  try
+  {
+    append_block(time_ds, times.data(), times.size(), 1, 0, 0, rows_written);
+    for (auto& s: sets) append_block(s.ds, rows.data(), times.size(), n_values, s.offset, s.width, rows_written);
+  }
+  catch (const H5::Exception& e)
+  {
+    fail("Cannot write HDF5 output", e);
+  }
+  rows_written += times.size();
+  times.clear();
+  rows.clear();
+}
+
+void
+h5_cell_writer::finish()
+{
+  flush();
+  std::lock_guard<std::mutex> g(h5_rank_file::lock);
+  try
+  {
+    int done = 1;
+    auto attr = group.createAttribute("finished", H5::PredType::NATIVE_INT, H5::DataSpace(H5S_SCALAR));
+    attr.write(H5::PredType::NATIVE_INT, &done);
+    attr.close();
+    H5Fflush(group.getId(), H5F_SCOPE_LOCAL);
+  }
+  catch (const H5::Exception& e)
+  {
+    fail("Cannot finish HDF5 output", e);
+  }
+}
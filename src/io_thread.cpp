@@ -0,0 +1,58 @@
+/*© 2023. Triad National Security, LLC. All rights reserved.
+This program was produced under U.S. Government contract 89233218CNA000001 for Los Alamos
+National Laboratory (LANL), which is operated by Triad National Security, LLC for the U.S.
+Department of Energy/National Nuclear Security Administration. All rights in the program are.
+reserved by Triad National Security, LLC, and the U.S. Department of Energy/National Nuclear
+Security Administration. The Government is granted for itself and others acting on its behalf a
+nonexclusive, paid-up, irrevocable worldwide license in this material to reproduce, prepare.
+derivative works, distribute copies to the public, perform publicly and display publicly, and to permit.
+others to do so.*/
+
+#include "io_thread.h"
+
+io_thread* io_thread::active = nullptr;
+
+io_thread::io_thread(size_t capacity)
+  : capacity(capacity ? capacity : 1)
+{
+  worker = std::thread(&io_thread::loop, this);
+}
+
+io_thread::~io_thread()
+{
+  {
+    std::lock_guard<std::mutex> g(lock);
+    stopping = true;
+  }
+  not_empty.notify_one();
+  worker.join();
+}
+
+void
+io_thread::push(std::function<void()> job)
+{
+  {
+    std::unique_lock<std::mutex> g(lock);
+    not_full.wait(g, [&] { return jobs.size() < capacity; });
+    jobs.push_back(std::move(job));
+  }
+  not_empty.notify_one();
+}
+
+void
+io_thread::loop()
+{
+  for (;;)
+  {
+    std::function<void()> job;
+    {
+      std::unique_lock<std::mutex> g(lock);
+      not_empty.wait(g, [&] { return stopping || !jobs.empty(); });
+      if (jobs.empty()) return;
+      job = std::move(jobs.front());
+      jobs.pop_front();
+    }
+    not_full.notify_all();
+    job();
+  }
+}
@@ -9,12 +9,15 @@ behalf a nonexclusive, paid-up, irrevocable worldwide license in this material
 to reproduce, prepare. derivative works, distribute copies to the public,
 perform publicly and display publicly, and to permit. others to do so.*/
 
+#include "async_log.h"
+#include "cell_container.h"
+#include "cellobserver.h"
 #include "configuration.h"
 #include "logging.h"
 #include "nudust.h"
+#include "stop_request.h"
 #include "timer.h"
 
-#include <plog/Initializers/RollingFileInitializer.h>
 #include <plog/Log.h>
 #include <string>
 #include <vector>
@@ -27,6 +30,7 @@ perform publicly and display publicly, and to permit. others to do so.*/
 #endif
 
 // TODO: (maybe) this should be it's own module...not a lot done tho
+#include <boost/filesystem.hpp>
 #include <boost/program_options.hpp>
 #include <boost/program_options/options_description.hpp>
 
@@ -58,7 +62,9 @@ and chemistry.
 int main(int argc, char *argv[]) {
   int rank = 0, size = 1;
 #ifdef NUDUSTC_ENABLE_MPI
-  MPI_Init(&argc, &argv);
+  // cells may be handed out from several threads (see task_counter)
+  int thread_level;
+  MPI_Init_thread(&argc, &argv, MPI_THREAD_SERIALIZED, &thread_level);
 
   MPI_Comm_rank(MPI_COMM_WORLD, &rank);
   MPI_Comm_size(MPI_COMM_WORLD, &size);
@@ -68,6 +74,10 @@ int main(int argc, char *argv[]) {
   // setup command-line options
   std::string config_filename;
   std::string log_filename;
+  std::string pack_filename;
+  std::string export_filename;
+  std::string extract_filename;
+  std::vector<uint32_t> extract_cells;
 
   po::options_description desc("nuDust options");
   desc.add_options()("help", "print help message")(
@@ -75,7 +85,15 @@ int main(int argc, char *argv[]) {
       "filename with runtime parameters")(
       "log_file,l",
       po::value<std::string>(&log_filename)->default_value("log.txt"),
-      "filename of log");
+      "filename of log")(
+      "pack,p", po::value<std::string>(&pack_filename),
+      "pack the input files of the configuration into a binary bundle and exit")(
+      "export,e", po::value<std::string>(&export_filename),
+      "write a binary cell output file as text (next to it, as .dat) and exit")(
+      "extract,x", po::value<std::string>(&extract_filename),
+      "write the cell output files held in a container (next to it) and exit")(
+      "cell", po::value<std::vector<uint32_t>>(&extract_cells)->multitoken(),
+      "cells to extract, all if not given");
 
   po::variables_map vm;
   po::store(po::parse_command_line(argc, argv, desc), vm);
@@ -86,6 +104,26 @@ int main(int argc, char *argv[]) {
     return 1;
   }
 
+  if (vm.count("export")) {
+    init_async_log(log_filename, plog::info);
+    auto text_filename = boost::filesystem::path(export_filename).replace_extension(".dat").string();
+    if (!export_observer_text(export_filename, text_filename)) {
+      std::cout << "! cannot export " << export_filename << ", see " << log_filename << "\n";
+      return 1;
+    }
+    std::cout << "! wrote " << text_filename << "\n";
+    return 0;
+  }
+
+  if (vm.count("extract")) {
+    init_async_log(log_filename, plog::info);
+    if (!extract_container(extract_filename, extract_cells)) {
+      std::cout << "! could not extract every cell of " << extract_filename << ", see " << log_filename << "\n";
+      return 1;
+    }
+    std::cout << "! extracted " << extract_filename << "\n";
+    return 0;
+  }
   if (!vm.count("config_file")) {
     std ::cout << "missing required configuration file!\n";
     std ::cout << "\tnudust++ -c data/inputs/default_config.ini\n";
@@ -95,7 +133,7 @@ int main(int argc, char *argv[]) {
   banner();
 
   std ::cout << "\n";
-  std ::cout << "! log file = " << log_filename << "\n";
+  std ::cout << "! log file = " << rank_log_name(log_filename, rank, size) << "\n";
   std ::cout << "! configuration file = " << config_filename << "\n";
   
 
@@ -112,7 +150,9 @@ int main(int argc, char *argv[]) {
   MPI_Barrier(MPI_COMM_WORLD);
 #endif
 
-  plog::init(plog::debug, log_filename.c_str());
+  // one file per rank, written from a background thread
+  log_filename = rank_log_name(log_filename, rank, size);
+  init_async_log(log_filename, plog::debug);
   plog::init<DetailLog_Root>(plog::info, &rootAppender);
   plog::init<DetailLog_Rank>(plog::info, &rankAppender);
 
@@ -124,17 +164,26 @@ int main(int argc, char *argv[]) {
 
   PLOGI << "nuDust has started";
 
-  nuDust nd(config_filename, size, rank);
-  std::cout << "! Setup has completed. Starting runs...\n";
-  nd.run();
-  std::cout << "! nuDust has finished!\n";
+  if (!pack_filename.empty()) {
+    if (rank == 0) {
+      nuDust nd(config_filename, 1, 0, pack_filename);
+      std::cout << "! packed inputs into " << pack_filename << "\n";
+    }
+  } else {
+    nuDust nd(config_filename, size, rank);
+    std::cout << "! Setup has completed. Starting runs...\n";
+    stop_request::install();
+    nd.run();
+    if (stop_request::pending()) {
+      std::cout << "! stopped by signal " << stop_request::signal_number()
+                << ", restart files written. Rerun to continue.\n";
+    } else {
+      std::cout << "! nuDust has finished!\n";
+    }
+  }
 
 #ifdef ENABLE_BENCHMARK
-  for (const auto &[k, v] : benchmark_map) {
-    auto call_avg = std::accumulate(v.begin(), v.end(), 0) / v.size();
-    SCLOG_A(rank) << "fn = " << k << " is called " << v.size()
-                  << " times: avg/call = " << call_avg << " us\n";
-  }
+  timing_registry::report(std::cout);
 #endif
 
 #ifdef NUDUSTC_ENABLE_MPI
@@ -4,18 +4,26 @@
 #include <string>
 #include <cmath>
 
-#include <boost/filesystem/path.hpp>
+#include <boost/archive/binary_iarchive.hpp>
+#include <boost/archive/binary_oarchive.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/serialization/string.hpp>
+#include <boost/serialization/vector.hpp>
 #include <boost/spirit/include/qi.hpp>
 #include <plog/Log.h>
 
 #include "network.h"
+#include "elements.h"
+#include "utilities.h"
 
 
 double M_Pi = 3.141592;
 
 network::network() :
-    n_reactions ( 0 ),
-    n_species ( 0 )
+    n_species ( 0 ),
+    n_reactions ( 0 )
 {
 }
 
@@ -24,49 +32,135 @@ network::~network()
 
 }
 
+namespace boost::serialization
+{
+template<class Archive>
+void serialize ( Archive &ar, reaction &r, const unsigned int /*version*/ )
+{
+    ar & r.reacts & r.prods & r.ks_list;
+    ar & r.alpha & r.beta & r.sigma & r.a_rad;
+    ar & r.type & r.extra;
+}
+} // namespace boost::serialization
+
 // read the network file and update the species list
+// the file is memory mapped and parsed in place. if use_cache is set, a
+// compiled copy of the network is kept next to the source as <stem>.nnet
+// and reused as long as the source file hash matches.
 void
-network::read_network ( const std::string &chemfile )
+network::read_network ( const std::string &chemfile, bool use_cache )
 {
-    //PLOGI << "Reading network from [" << chemfile << "]";
+    namespace bip = boost::interprocess;
 
-    std::ifstream ifs ( chemfile.c_str(), std::ifstream::in );
-    ifs.unsetf ( std::ios::skipws );
-    boost::spirit::istream_iterator f ( ifs ), l;
+    if ( !boost::filesystem::exists ( chemfile ) || boost::filesystem::file_size ( chemfile ) == 0 )
+    {
+        PLOGE << "Cannot open network file " << chemfile;
+        exit ( 1 );
+    }
 
-    //PLOGI << "Network file [" << chemfile << "] opened";
+    bip::file_mapping chem_map ( chemfile.c_str(), bip::read_only );
+    bip::mapped_region chem_region ( chem_map, bip::read_only );
 
-    network_parser<boost::spirit::istream_iterator, qi::blank_type> p;
+    const char *f = static_cast<const char *> ( chem_region.get_address() );
+    const char *l = f + chem_region.get_size();
 
-    //PLOGI << "parser applied";
+    network_label = boost::filesystem::path(chemfile).stem().string();
 
-    bool ok = qi::phrase_parse ( f, l, p, qi::blank, reactions );
+    // FNV-1a over the raw file: the key of the compiled cache, and stored
+    // in restart files to catch restarts with a different network
+    auto src_hash = utilities::fnv1a ( f, chem_region.get_size() );
+    source_hash = src_hash;
+    auto cachefile = boost::filesystem::path(chemfile).replace_extension(".nnet").string();
 
-    if ( ok )
+    if ( use_cache && read_cache ( cachefile, src_hash ) )
     {
-        //PLOGI << "parser ok";
+        PLOGI << "loaded compiled network from " << cachefile;
+        return;
     }
-    else
+
+    network_parser<const char *, qi::blank_type> p;
+
+    bool ok = qi::phrase_parse ( f, l, p, qi::blank, reactions );
+
+    if ( !ok )
     {
         PLOGE << chemfile << " parser fail!!";
         exit ( 1 );
     }
 
-    //if ( f != l ) PLOGI << "remaining unparsed: '" << std::string ( f, l ) << "'";
-
-    //PLOGI << "getting species from network...";
     get_species_list();
 
     n_reactions = reactions.size();
     n_species = species.size();
 
-    //PLOGI << "mapping species index to reactions...";
     map_species_to_reactions();
 
-    //PLOGI << "network loaded from [" << chemfile << "]";
-    //PLOGI << "got " << n_species << " species in " << n_reactions << " reactions";
+    if ( use_cache )
+    {
+        write_cache ( cachefile, src_hash );
+    }
+}
 
-    network_label = boost::filesystem::path(chemfile).stem().string();
+// load a compiled network. returns false if the cache is missing or stale
+bool
+network::read_cache ( const std::string &cachefile, uint64_t src_hash )
+{
+    std::ifstream ifs ( cachefile, std::ios::binary );
+    if ( !ifs.is_open() )
+    {
+        return false;
+    }
+    try
+    {
+        boost::archive::binary_iarchive ia ( ifs );
+        uint32_t version;
+        uint64_t hash;
+        ia >> version >> hash;
+        if ( version != NETWORK_CACHE_VERSION || hash != src_hash )
+        {
+            PLOGI << "network cache " << cachefile << " is out of date";
+            return false;
+        }
+        ia >> n_gas_species >> n_nucleation_species;
+        ia >> reactions >> species >> reactants_idx >> products_idx >> ks_lists_idx >> gases_idx >> grn_names;
+    }
+    catch ( const std::exception &e )
+    {
+        PLOGW << "cannot read network cache " << cachefile << ": " << e.what();
+        reactions.clear();
+        return false;
+    }
+    n_reactions = reactions.size();
+    n_species = species.size();
+    build_species_lookup();
+    return true;
+}
+
+// write the compiled network. written to a temporary and renamed so
+// concurrent ranks never see a partial file
+void
+network::write_cache ( const std::string &cachefile, uint64_t src_hash ) const
+{
+    auto tmpfile = boost::filesystem::unique_path ( cachefile + ".%%%%%%" );
+    {
+        std::ofstream ofs ( tmpfile.string(), std::ios::binary );
+        if ( !ofs.is_open() )
+        {
+            PLOGW << "cannot write network cache " << cachefile;
+            return;
+        }
+        boost::archive::binary_oarchive oa ( ofs );
+        oa << NETWORK_CACHE_VERSION << src_hash;
+        oa << n_gas_species << n_nucleation_species;
+        oa << reactions << species << reactants_idx << products_idx << ks_lists_idx << gases_idx << grn_names;
+    }
+    boost::system::error_code ec;
+    boost::filesystem::rename ( tmpfile, cachefile, ec );
+    if ( ec )
+    {
+        PLOGW << "cannot write network cache " << cachefile << ": " << ec.message();
+        boost::filesystem::remove ( tmpfile, ec );
+    }
 }
 
 /*
@@ -78,7 +172,7 @@ network::read_network ( const std::string &chemfile )
 void
 network::post_process()
 {
-    for ( auto i = 0 ; i < n_reactions; ++i )
+    for ( size_t i = 0 ; i < n_reactions; ++i )
     {
         if ( reactions[i].type == REACTION_TYPE_NUCLEATE )
         {
@@ -130,15 +224,25 @@ network::post_process()
 int
 network::get_species_index ( const std::string &spec ) const
 {
-    auto it = std::find ( std :: begin(species), std :: end(species), spec );
+    auto it = species_lookup.find ( spec );
     auto idx = -1;
-    if ( it != species.end() )
-        idx = std::distance ( std :: begin(species), it );
+    if ( it != species_lookup.end() )
+        idx = it->second;
     //else
         //PLOGE << "ERROR: cannot find species(" << spec << ")";
     return idx;
 }
 
+// rebuild the name -> index map after the species list changes
+void
+network::build_species_lookup()
+{
+    species_lookup.clear();
+    species_lookup.reserve ( species.size() );
+    for ( size_t i = 0; i < species.size(); ++i )
+        species_lookup.emplace ( species[i], i );
+}
+
 /*
  * maps reactions/products species to their respective
  * indices. this is functionally a std::map, but std::map
@@ -150,13 +254,15 @@ network::map_species_to_reactions()
     reactants_idx.resize ( n_reactions );
     products_idx.resize ( n_reactions );
     ks_lists_idx.resize ( n_reactions );
-    for ( auto i = 0; i < n_reactions; ++i )
+    std::unordered_set<size_t> gas_set;
+    for ( size_t i = 0; i < n_reactions; ++i )
     {
         for ( const auto &reactant : reactions[i].reacts )
         {
-            reactants_idx[i].push_back ( get_species_index ( reactant ) );
-            if (std::find(gases_idx.begin(), gases_idx.end(), get_species_index ( reactant )) == gases_idx.end())
-                gases_idx.push_back(get_species_index ( reactant ));
+            auto r_idx = get_species_index ( reactant );
+            reactants_idx[i].push_back ( r_idx );
+            if ( gas_set.insert ( r_idx ).second )
+                gases_idx.push_back ( r_idx );
         }
         for ( const auto &product : reactions[i].prods )
         {
@@ -172,8 +278,13 @@ network::map_species_to_reactions()
 
 /*
  * constructs the internal species list from the network.
- * this is a slight hack of std::unordered_set, which
- * only allows unique inserts.
+ * the order is canonical (independent of hashing) and grouped
+ * for locality in the solution vector:
+ *  - gas species (anything consumed by a reaction), reactants of
+ *    nucleation reactions first, added reaction by reaction so the
+ *    reactants of each reaction sit next to each other
+ *  - the remaining species of nucleation reactions (condensates)
+ *  - everything else, in order of first appearance
  */
 void
 network::get_species_list()
@@ -182,16 +293,40 @@ network::get_species_list()
 
     species.clear();
 
-    for ( const auto &r : reactions )
+    auto add_species = [&] ( const spec_v &specs )
     {
-        spec_set.insert ( r.reacts.begin(), r.reacts.end() );
-        spec_set.insert ( r.prods.begin(), r.prods.end() );
-    }
-    //spec_v oxy{"CO","SiO"};
-    //spec_set.insert(oxy.begin(),oxy.end());
-    species.insert ( species.begin(), spec_set.begin(), spec_set.end() );
+        for ( const auto &s : specs )
+            if ( spec_set.insert ( s ).second )
+                species.push_back ( s );
+    };
+
+    for ( const auto &r : reactions )
+        if ( r.type == REACTION_TYPE_NUCLEATE )
+            add_species ( r.reacts );
+    for ( const auto &r : reactions )
+        if ( r.type != REACTION_TYPE_NUCLEATE )
+            add_species ( r.reacts );
+    n_gas_species = species.size();
+
+    for ( const auto &r : reactions )
+        if ( r.type == REACTION_TYPE_NUCLEATE )
+            add_species ( r.prods );
+    n_nucleation_species = species.size() - n_gas_species;
 
-    auto s_id = 0;
+    for ( const auto &r : reactions )
+        add_species ( r.prods );
 
+    build_species_lookup();
 }
 
+// look up the atomic mass of every species once, so cells do not need
+// their own element table
+void
+network::set_species_masses(const xkin::element_list_t& elements)
+{
+    species_mass.resize ( species.size() );
+    for ( size_t i = 0; i < species.size(); ++i )
+    {
+        species_mass[i] = elements.mass_of ( species[i] );
+    }
+}
@@ -11,13 +11,23 @@ others to do so.*/
 #include "nudust.h"
 
 #include "constants.h"
+#include "elements.h"
 #include "utilities.h"
 #include "sputter.h"
 #include "sput_params.h"
+#include "text_table.h"
+#include "scheduler.h"
+#include "task_farm.h"
+#include "io_thread.h"
+#include "cellobserver.h"
+#include "restart_file.h"
+#include "stop_request.h"
+#include "reductions.h"
 
 #include <vector>
 #include <string>
 #include <chrono>
+#include <numeric>
 #include <fstream>
 #include <filesystem>
 #include <boost/filesystem.hpp>
@@ -30,33 +40,100 @@ others to do so.*/
 
 namespace options = boost::program_options;
 
-nuDust::nuDust ( const std::string &config_file, int sz, int rk) : par_size(sz), par_rank(rk), sputter("data/sputterDict.json")
+nuDust::nuDust ( const std::string &config_file, int sz, int rk, const std::string &pack_file) : sputter("data/sputterDict.json"), par_size(sz), par_rank(rk)
 {
     PLOGI << "par_size: " << par_size << ", par_rank: " << par_rank;
     nu_config.read_config ( config_file );
+    if(nu_config.cell_distribution!="block" && nu_config.cell_distribution!="dynamic")
+    {
+        PLOGE << "unknown cell_distribution " << nu_config.cell_distribution << " (block or dynamic)";
+        exit(1);
+    }
+    if(nu_config.output_format!="text" && nu_config.output_format!="binary" && nu_config.output_format!="compressed" && nu_config.output_format!="hdf5")
+    {
+        PLOGE << "unknown output_format " << nu_config.output_format << " (text, binary, compressed or hdf5)";
+        exit(1);
+    }
+#ifndef NUDUSTC_ENABLE_HDF5
+    if(nu_config.output_format=="hdf5")
+    {
+        PLOGE << "output_format hdf5 needs a build with NUDUSTC_ENABLE_HDF5";
+        exit(1);
+    }
+#endif
+    if(nu_config.reduce_n_times>0 && !(nu_config.reduce_t_min>0 && nu_config.reduce_t_max>nu_config.reduce_t_min))
+    {
+        PLOGE << "the reduction grid needs 0 < reduce_t_min < reduce_t_max";
+        exit(1);
+    }
+    if(nu_config.output_container==1 && nu_config.output_format=="hdf5")
+    {
+        PLOGE << "output_container does not apply to output_format hdf5, which already writes one file per rank";
+        exit(1);
+    }
+    // packing needs every input in memory at once
+    dynamic_cells = nu_config.cell_distribution=="dynamic" && pack_file.empty();
+    // in dynamic mode every rank holds the (small) per-cell inputs of all
+    // cells, but reads a trajectory only for the cells it ends up running
+    lazy_cells = (nu_config.lazy_cells==1 || dynamic_cells) && pack_file.empty();
     // these are always called
     load_network();
-    load_initial_abundances();
+
+    if(!nu_config.input_bundle.empty())
+    {
+        // abundances, size distribution, environment and shock data from a packed bundle
+        load_bundle();
+    }
+    else
+    {
+        // decide which cells this rank owns before any cell data is parsed;
+        // the loaders below only store the owned cells
+        auto all_cell_ids = scan_cell_ids();
+        if(pack_file.empty())
+        {
+            decompose_cells(all_cell_ids);
+        }
+        else
+        {
+            // packing keeps every cell
+            rank_cell_ids = all_cell_ids;
+        }
+        load_initial_abundances();
+
+        if(!nu_config.sizeDist_file.empty())
+        {
+            load_sizeDist();
+        }
+        if(!nu_config.environment_file.empty())
+        {
+            load_environment_data();
+        }
+        if(nu_config.do_destruction==1 && !nu_config.shock_file.empty())
+        {
+            // read in shock file
+            load_shock_params();
+        }
+    }
+
+    if(!pack_file.empty())
+    {
+        write_bundle(pack_file);
+        return;
+    }
 
     ////////////////////////////////////////////////
     // these are called depending on the config file
-    // either make a new size bin or read in the size bin from a file
-    int (nu_config.sizeDist_file.empty()) ? gen_size_dist() : load_sizeDist();
-    // nucleation and destrcution + nucleation path
-
-    if(!nu_config.environment_file.empty())
+    // make a new size bin if there is no size distribution file
+    if(nu_config.sizeDist_file.empty())
     {
-        load_environment_data();
+        gen_size_dist();
     }
+    // nucleation and destrcution + nucleation path
+
     // destruction
     if(nu_config.do_destruction==1)
     {
         load_sputter_params();
-        if(!nu_config.shock_file.empty())
-        {
-            // read in shock file
-            load_shock_params();
-        }
         if(!isnan(nu_config.shock_velo))
         {
             // create shock velo and temp arrays from user specifies shock temp and velocity
@@ -68,15 +145,74 @@ nuDust::nuDust ( const std::string &config_file, int sz, int rk) : par_size(sz),
     // always run but needed at the end
     generate_sol_vector();
     load_outputFL_names();
+#ifdef NUDUSTC_ENABLE_HDF5
+    if(nu_config.output_format=="hdf5")
+    {
+        h5_out = std::make_unique<h5_rank_file>(name+"r"+std::to_string(par_rank)+".h5");
+        h5_rank_file::active = h5_out.get();
+    }
+#endif
+    if(nu_config.output_container==1)
+    {
+        auto stem = "B"+std::to_string(nu_config.bin_number)+"_"+net.network_label+"_";
+        container = std::make_unique<cell_container>(name+"r"+std::to_string(par_rank)+".nuc", true, stem,
+                                                     output_extension(nu_config.output_format));
+        cell_container::active = container.get();
+    }
     create_simulation_cells();
 }
 
+// write the loaded file inputs of every cell to a binary bundle
+void
+nuDust::write_bundle(const std::string &pack_file)
+{
+    uint32_t flags = 0;
+    if(!nu_config.sizeDist_file.empty()) flags |= BUNDLE_HAS_SIZE_DIST;
+    if(!nu_config.environment_file.empty()) flags |= BUNDLE_HAS_ENV;
+    if(nu_config.do_destruction==1 && !nu_config.shock_file.empty()) flags |= BUNDLE_HAS_SHOCK;
+    input_bundle::write(pack_file, flags, initial_elements, net.n_reactions, size_bins_init, init_bin_edges, cell_inputs);
+}
+
+// load this rank's cells from a packed bundle instead of the text inputs
+void
+nuDust::load_bundle()
+{
+    if(!bundle.open(nu_config.input_bundle))
+    {
+        PLOGE << "Cannot open input bundle " << nu_config.input_bundle;
+        exit(1);
+    }
+    if((bundle.header->flags & BUNDLE_HAS_SIZE_DIST) && bundle.header->n_grains != net.n_reactions)
+    {
+        PLOGE << "input bundle " << nu_config.input_bundle << " was packed for a network with "
+              << bundle.header->n_grains << " grains, this network has " << net.n_reactions;
+        exit(1);
+    }
+    initial_elements = bundle.element_names();
+    auto bins = bundle.size_bins();
+    auto edges = bundle.bin_edges();
+    size_bins_init.assign(bins.begin(), bins.end());
+    init_bin_edges.assign(edges.begin(), edges.end());
+    if(bundle.header->flags & BUNDLE_HAS_SIZE_DIST)
+    {
+        numBins = size_bins_init.size();
+    }
+    decompose_cells(bundle.cell_ids());
+    // in lazy mode the environment is copied out when each cell is built
+    bundle.load_cells(rank_cell_ids, cell_inputs, !lazy_cells);
+    PLOGI << "loaded " << rank_cell_ids.size() << " cells from input bundle " << nu_config.input_bundle;
+}
+
 // make sure the network is loaded
 void
 nuDust::load_network()
 {
-    net.read_network ( nu_config.network_file );
+    net.read_network ( nu_config.network_file, nu_config.use_network_cache==1 );
     net.post_process();  
+    // the element table is only needed for the species masses, so it is
+    // read once here instead of by every cell
+    xkin::element_list_t elements ( "data/elements.json" );
+    net.set_species_masses ( elements );
     PLOGI << "loaded network file";
 }
 
@@ -158,23 +294,23 @@ void
 nuDust::load_sizeDist()
 {
     // This loads just the input size distribution file. It get grain sizes and species included.
-    std::ifstream sd_file ( nu_config.sizeDist_file );
-    std::string line_buffer;
-    std::vector<std::string> line_tokens;
+    text_table sd_file;
 
-    if ( sd_file.is_open() )
+    if ( sd_file.open ( nu_config.sizeDist_file ) )
     {   
-        std::vector<std::string>  SD_grn_names;
-        std::getline ( sd_file, line_buffer );
-        boost::split ( line_tokens, line_buffer, boost::is_any_of ( " \t" ), boost::token_compress_on );
-        SD_grn_names.assign ( line_tokens.begin(), line_tokens.end() );
-
-        std::getline ( sd_file, line_buffer );
-        boost::split ( line_tokens, line_buffer, boost::is_any_of ( " \t" ), boost::token_compress_on );
-
-        for ( auto it = line_tokens.begin() ; it != line_tokens.end(); ++it )
+        auto SD_grn_names = text::split_words ( sd_file.next_line() );
+        auto size_line = sd_file.next_line();
+        const char* p = size_line.data();
+        const char* end = p + size_line.size();
+        double size_val;
+        while ( text::skip_blank ( p, end ) < end )
         {
-            size_bins_init.push_back ( boost::lexical_cast<double> ( *it ));
+            if ( !text::parse_token ( p, end, size_val ) )
+            {
+                PLOGE << "bad size bin in sd file " << nu_config.sizeDist_file;
+                exit(1);
+            }
+            size_bins_init.push_back ( size_val );
         }
  
         numBins = size_bins_init.size();
@@ -186,47 +322,45 @@ nuDust::load_sizeDist()
         
         std::vector<int> grn_idx(net.n_reactions);
         // match grians: network ID with input file ID
-        for( auto fn_id = 0; fn_id < SD_grn_names.size(); fn_id++){
-            for(auto gn_id =0; gn_id < net.n_reactions; gn_id++){
+        for( size_t fn_id = 0; fn_id < SD_grn_names.size(); fn_id++){
+            for(size_t gn_id =0; gn_id < net.n_reactions; gn_id++){
                 if(SD_grn_names[fn_id]==net.reactions[gn_id].prods[0])
                 {
                     grn_idx[gn_id]=fn_id;
                 }
             }
         }
-        while ( std::getline ( sd_file, line_buffer ) )
+        size_t row_width = 1;
+        for( size_t gid=0; gid<net.n_reactions; gid++)
         {
-            boost::split ( line_tokens, line_buffer, boost::is_any_of ( " \t" ), boost::token_compress_on );
-            auto cell_id = boost::lexical_cast<int> ( line_tokens[0] );
-            auto cell_time = boost::lexical_cast<double> ( line_tokens[1] );
-            cell_inputs[cell_id].inp_cell_time = cell_time;
-            std::vector<double> input_SD;
-            cell_inputs[cell_id].inp_binSizes.resize(numBins);
-            std::copy(size_bins_init.begin(),size_bins_init.end(),cell_inputs[cell_id].inp_binSizes.begin());
-            cell_inputs[cell_id].inp_binEdges.resize(numBins+1);
-            std::copy(init_bin_edges.begin(),init_bin_edges.end(),cell_inputs[cell_id].inp_binEdges.begin());
+            row_width = std::max<size_t>(row_width, 1 + (grn_idx[gid]+1)*numBins);
+        }
 
-            for ( auto it = line_tokens.begin() + 2; it != line_tokens.end(); ++it )
+        for ( const auto &chunk : sd_file.parse_rows ( nu_config.parse_threads, &rank_cell_ids ) )
+        {
+            if ( chunk.bad_byte != std::string::npos )
             {
-                try
-                {   
-                    input_SD.push_back ( boost::lexical_cast<double> ( *it ));
-                }
-                catch(const std::exception& e)
+                PLOGE << "bad value in sd file at byte " << chunk.bad_byte;
+                exit(1);
+            }
+            for ( size_t r = 0; r < chunk.n_rows(); ++r )
+            {
+                auto cell_id = chunk.ids[r];
+                if ( chunk.width(r) < row_width )
                 {
                     PLOGE << "bad value in sd file line "<< cell_id;
-                    input_SD.push_back ( boost::lexical_cast<double> ( 0.0 ) );
                     exit(1);
                 }
-            }
-            cell_inputs[cell_id].inp_size_dist.resize(net.n_reactions*numBins);
-            cell_inputs[cell_id].inp_delSZ.resize(net.n_reactions*numBins);
-            std::fill(cell_inputs[cell_id].inp_delSZ.begin(),cell_inputs[cell_id].inp_delSZ.end(),0.0);
-            for( auto gid=0; gid<net.n_reactions; gid++)
-            {
-                for( auto sid=0; sid<numBins; sid++)
+                const double* input_SD = chunk.row(r) + 1;
+                auto &ci = cell_inputs[cell_id];
+                ci.inp_cell_time = chunk.row(r)[0];
+                ci.inp_binSizes.assign(size_bins_init.begin(), size_bins_init.end());
+                ci.inp_binEdges.assign(init_bin_edges.begin(), init_bin_edges.end());
+                ci.inp_size_dist.resize(net.n_reactions*numBins);
+                ci.inp_delSZ.assign(net.n_reactions*numBins, 0.0);
+                for( size_t gid=0; gid<net.n_reactions; gid++)
                 {
-                    cell_inputs[cell_id].inp_size_dist[gid*numBins+sid]=input_SD[grn_idx[gid]*numBins+sid];
+                    std::copy_n(input_SD + grn_idx[gid]*numBins, numBins, ci.inp_size_dist.begin() + gid*numBins);
                 }
             }
         }
@@ -238,21 +372,39 @@ nuDust::load_sizeDist()
     }
 }
 
+// the ids of all cells, ascending, from the abundance file
+std::vector<uint32_t>
+nuDust::scan_cell_ids()
+{
+    text_table abundance_file;
+    if ( !abundance_file.open ( nu_config.abundance_file ) )
+    {
+        PLOGE << "Cannot open abundance file " << nu_config.abundance_file;
+        exit(1);
+    }
+    abundance_file.next_line();
+    auto ids = abundance_file.scan_ids ( nu_config.parse_threads );
+    std::sort ( ids.begin(), ids.end() );
+    ids.erase ( std::unique ( ids.begin(), ids.end() ), ids.end() );
+    PLOGI << "found " << ids.size() << " cells in " << nu_config.abundance_file;
+    return ids;
+}
+
 // load the abundance file
 void
 nuDust::load_initial_abundances()
 {
-    std::ifstream abundance_file ( nu_config.abundance_file );
-    std::string line_buffer;
-    std::vector<std::string> line_tokens;
+    text_table abundance_file;
 
-    if ( abundance_file.is_open() )
+    if ( abundance_file.open ( nu_config.abundance_file ) )
     {
         bool missingCO = true;
         bool missingSiO = true;
-        std::getline ( abundance_file, line_buffer );
-        boost::split ( line_tokens, line_buffer, boost::is_any_of ( " \t" ), boost::token_compress_on );
-        initial_elements.assign ( line_tokens.begin() + 1, line_tokens.end() );
+        auto line_tokens = text::split_words ( abundance_file.next_line() );
+        if ( !line_tokens.empty() )
+        {
+            initial_elements.assign ( line_tokens.begin() + 1, line_tokens.end() );
+        }
         // checking to see if CO is in the input file
         if(std::find(initial_elements.begin(), initial_elements.end(), "CO") != initial_elements.end())
         {
@@ -274,35 +426,39 @@ nuDust::load_initial_abundances()
             initial_elements.emplace_back("SiO");
         }
 
-        while ( std::getline ( abundance_file, line_buffer ) )
-        {
-            boost::split ( line_tokens, line_buffer, boost::is_any_of ( " \t" ), boost::token_compress_on );
-
-            auto cell_id = boost::lexical_cast<int> ( line_tokens[0] );
-            // getting indices for premaking CO and SiO
-            auto CO_idx  = get_element_index("CO");
-            auto C_idx   = get_element_index("C");
-            auto O_idx   = get_element_index("O");
-            auto SiO_idx = get_element_index("SiO");
-            auto Si_idx  = get_element_index("Si");
+        // getting indices for premaking CO and SiO
+        auto CO_idx  = get_element_index("CO");
+        auto C_idx   = get_element_index("C");
+        auto O_idx   = get_element_index("O");
+        auto SiO_idx = get_element_index("SiO");
+        auto Si_idx  = get_element_index("Si");
 
-            for (auto it = line_tokens.begin() + 1; it != line_tokens.end(); ++it) 
-            {
-                cell_inputs[cell_id].inp_init_abund.push_back(boost::lexical_cast<double>(*it));
-            }
-            // only add an extra spot for CO if it isn't in the input abundance file
-            if(missingCO)
+        for ( const auto &chunk : abundance_file.parse_rows ( nu_config.parse_threads, &rank_cell_ids ) )
+        {
+            if ( chunk.bad_byte != std::string::npos )
             {
-                cell_inputs[cell_id].inp_init_abund.push_back(0.0);
+                PLOGE << "bad value in abundance file at byte " << chunk.bad_byte;
+                exit(1);
             }
-            // only add an extra spot for CO if it isn't in the input abundance file
-            if(missingSiO)
+            for ( size_t r = 0; r < chunk.n_rows(); ++r )
             {
-                cell_inputs[cell_id].inp_init_abund.push_back(0.0);
+                auto cell_id = chunk.ids[r];
+                auto &abund = cell_inputs[cell_id].inp_init_abund;
+                abund.assign(chunk.row(r), chunk.row(r) + chunk.width(r));
+                // only add an extra spot for CO if it isn't in the input abundance file
+                if(missingCO)
+                {
+                    abund.push_back(0.0);
+                }
+                // only add an extra spot for CO if it isn't in the input abundance file
+                if(missingSiO)
+                {
+                    abund.push_back(0.0);
+                }
+                // premake CO and SiO
+                premake(C_idx, O_idx, CO_idx, cell_id);
+                premake(Si_idx, O_idx, SiO_idx, cell_id);
             }
-            // premake CO and SiO
-            premake(C_idx, O_idx, CO_idx, cell_id);
-            premake(Si_idx, O_idx, SiO_idx, cell_id);
         }
     }
     else
@@ -344,7 +500,10 @@ nuDust::account_for_pileUp()
             cell_inputs[cell_id].inp_init_abund[idx] *= pileUpFactor * std::pow(cell_inputs[cell_id].inp_shock_time/cell_inputs[cell_id].inp_cell_time,-3.0);
         }
     }
-    PLOGI << cell_inputs[1].inp_init_abund[0] << " after adjust for time";
+    if ( !cell_inputs.empty() && !cell_inputs.begin()->second.inp_init_abund.empty() )
+    {
+        PLOGI << cell_inputs.begin()->second.inp_init_abund[0] << " after adjust for time";
+    }
 }
 
 // load the sputter parameters and calcuate additional constants needed for thermal and nonthermal sputtering
@@ -435,70 +594,79 @@ nuDust::load_sputter_params()
     PLOGI << "calculated sputtering terms";
 }
 
+// pick the cells this rank runs from all cell ids (ascending). in block
+// mode each rank gets a contiguous block, the first n_cells % par_size
+// ranks one cell more. in dynamic mode every rank keeps every cell and
+// run() hands them out
+void
+nuDust::decompose_cells(const std::vector<uint32_t> &all_cell_ids)
+{
+  if(dynamic_cells)
+  {
+    rank_cell_ids = all_cell_ids;
+    PLOGI << "rank " << par_rank << " shares " << rank_cell_ids.size() << " cells with " << par_size << " ranks";
+    return;
+  }
+
+  size_t n_cells = all_cell_ids.size();
+  size_t cells_per_rank = n_cells / par_size;
+  size_t n_extra = n_cells % par_size;
+  size_t rank = par_rank;
+  size_t cell_start = rank * cells_per_rank + std::min(rank, n_extra);
+  size_t cell_end = cell_start + cells_per_rank + (rank < n_extra ? 1 : 0);
+
+  rank_cell_ids.assign(all_cell_ids.begin() + cell_start, all_cell_ids.begin() + cell_end);
+  PLOGI << "rank " << par_rank << " owns " << rank_cell_ids.size() << " cells";
+}
+
 // load the trajectory (environment) data
+// the file is indexed once and only the cells run by this rank are parsed
 void
 nuDust::load_environment_data()
 {
-    std::ifstream env_file(nu_config.environment_file);
-    std::string line_buffer;
-    std::vector<std::string> line_tokens;
-    double time;
-    if (env_file.is_open()) {
-        while (std::getline(env_file, line_buffer)) 
-        {
-            boost::split(line_tokens, line_buffer, boost::is_any_of(" \t "));
-            if (line_tokens.size() == 1) 
-            {
-                time = boost::lexical_cast<double>(line_tokens[0]);
-            } 
-            else 
-            {
-                auto cid   = boost::lexical_cast<int>(line_tokens[0]);
-                auto temp  = boost::lexical_cast<double>(line_tokens[1]);
-                auto vol   = boost::lexical_cast<double>(line_tokens[2]);
-                auto rho   = boost::lexical_cast<double>(line_tokens[3]);
-                auto press = boost::lexical_cast<double>(line_tokens[4]);
-                auto velo = boost::lexical_cast<double>(line_tokens[5]);
-                auto x_cm = boost::lexical_cast<double>(line_tokens[6]);
-
-                cell_inputs[cid].inp_times.push_back(time);
-                cell_inputs[cid].inp_temp.push_back(temp);
-                cell_inputs[cid].inp_volumes.push_back(vol);
-                cell_inputs[cid].inp_rho.push_back(rho);
-                cell_inputs[cid].inp_pressure.push_back(press);
-                cell_inputs[cid].inp_velo.push_back(velo);
-                cell_inputs[cid].inp_x_cm.push_back(x_cm);
-            }
-        }
-    }
-    else {
+    if ( !env_index.open ( nu_config.environment_file ) )
+    {
         PLOGE << "Cannont open environment file " << nu_config.environment_file;
+        return;
+    }
+    if ( lazy_cells )
+    {
+        // each cell's trajectory is parsed when the cell is built
+        PLOGI << "indexed environment file, cells load their own trajectory";
+        return;
     }
-    PLOGI << "loaded environment file";
+    env_index.load_cells ( rank_cell_ids, cell_inputs );
+    PLOGI << "loaded environment file for " << rank_cell_ids.size() << " cells";
 }
 
 // load the shock time, temperature, and velocity from the user specified shock file
 void
 nuDust::load_shock_params()
 {
-    std::ifstream sd_file ( nu_config.shock_file );
-    std::string line_buffer;
-    std::vector<std::string> line_tokens;
-
-    int cell_id  = 0;
-    double shock_velo = 0.0;
+    text_table sd_file;
 
-    if ( sd_file.is_open() )
+    if ( sd_file.open ( nu_config.shock_file ) )
     {           
-        while ( std::getline ( sd_file, line_buffer ) )
+        for ( const auto &chunk : sd_file.parse_rows ( nu_config.parse_threads, &rank_cell_ids ) )
         {
-            boost::split ( line_tokens, line_buffer, boost::is_any_of ( " \t" ), boost::token_compress_on );
-            cell_id = boost::lexical_cast<int> ( line_tokens[0] );
-            cell_inputs[cell_id].inp_shock_time = boost::lexical_cast<double> ( line_tokens[1] );
-            cell_inputs[cell_id].inp_shock_temp = boost::lexical_cast<double> ( line_tokens[2] );
-            shock_velo = boost::lexical_cast<double> ( line_tokens[3] );
-            cell_inputs[cell_id].inp_vd.resize(size_bins_init.size()*net.n_reactions);
-            std::fill(cell_inputs[cell_id].inp_vd.begin(), cell_inputs[cell_id].inp_vd.end(), shock_velo);
+            if ( chunk.bad_byte != std::string::npos )
+            {
+                PLOGE << "bad value in shock param file at byte " << chunk.bad_byte;
+                exit(1);
+            }
+            for ( size_t r = 0; r < chunk.n_rows(); ++r )
+            {
+                auto cell_id = chunk.ids[r];
+                if ( chunk.width(r) < 3 )
+                {
+                    PLOGE << "missing values in shock param file for cell " << cell_id;
+                    exit(1);
+                }
+                const double* row = chunk.row(r);
+                cell_inputs[cell_id].inp_shock_time = row[0];
+                cell_inputs[cell_id].inp_shock_temp = row[1];
+                cell_inputs[cell_id].inp_vd.assign(size_bins_init.size()*net.n_reactions, row[2]);
+            }
         }
         //account_for_pileUp();
     }
@@ -586,46 +754,123 @@ nuDust::load_outputFL_names()
     PLOGI << "data and restart file names defined";
 }
 
-// if a restart file exists for the cell, load data from file
-void
+// whether the cell has written its output file (or, with hdf5, finished
+// its group in this rank's file). without cell output a finished cell
+// leaves a .done file instead
+bool
+nuDust::output_exists(uint32_t cid)
+{
+    if(nu_config.cell_output==0 && !container)
+    {
+        return std::filesystem::exists(name+std::to_string ( cid ) + ".done");
+    }
+#ifdef NUDUSTC_ENABLE_HDF5
+    if(h5_out)
+    {
+        return h5_out->cell_finished(cid);
+    }
+#endif
+    if(container)
+    {
+        return container->cell_finished(cid);
+    }
+    return std::filesystem::exists(name+std::to_string ( cid ) + output_extension(nu_config.output_format));
+}
+
+// whether the cell has a restart to continue from. with hdf5 the restart
+// file is only of use on the rank whose file holds the cell's output
+bool
+nuDust::restart_exists(uint32_t cid)
+{
+    if(container)
+    {
+        return container->has_restart(cid);
+    }
+    bool has_file = std::filesystem::exists(nameRS+std::to_string ( cid ) + ".rst");
+#ifdef NUDUSTC_ENABLE_HDF5
+    if(h5_out && nu_config.cell_output==1)
+    {
+        return has_file && h5_out->cell_rows(cid) > 0;
+    }
+#endif
+    return has_file;
+}
+
+namespace
+{
+const uint8_t CELL_FINISHED = 1;
+const uint8_t CELL_RESTART  = 2;
+}
+
+// a container or hdf5 file per rank only knows the cells its own rank
+// ran. in dynamic mode every rank needs the same shared list, so this
+// combines, for each cell of rank_cell_ids, whether any rank has finished
+// it (CELL_FINISHED) or holds its restart (CELL_RESTART)
+std::vector<uint8_t>
+nuDust::shared_cell_flags()
+{
+    std::vector<uint8_t> flags(rank_cell_ids.size(), 0);
+    for(size_t k = 0; k < rank_cell_ids.size(); ++k)
+    {
+        if(restart_exists(rank_cell_ids[k])) flags[k] = CELL_RESTART;
+        else if(output_exists(rank_cell_ids[k])) flags[k] = CELL_FINISHED;
+    }
+#ifdef NUDUSTC_ENABLE_MPI
+    MPI_Allreduce(MPI_IN_PLACE, flags.data(), flags.size(), MPI_UNSIGNED_CHAR, MPI_BOR, MPI_COMM_WORLD);
+#endif
+    return flags;
+}
+
+// load the restart file of a cell into its input. false (after a warning)
+// if the file is damaged, from another network or does not fit the cell,
+// in which case the cell starts over
+bool
 nuDust::create_restart_cells(int cell_id)
 {
-    std::ifstream rs_file ( nameRS+std::to_string ( cell_id ) + ".dat" );
-    std::string line_buffer;
-    std::vector<std::string> line_tokens;
+    auto rs_name = nameRS+std::to_string ( cell_id ) + ".rst";
+    restart_state st;
+    if(container)
+    {
+        std::string contents;
+        rs_name = "restart of cell " + std::to_string(cell_id) + " in the container";
+        if ( not container->read_restart(cell_id, contents) ||
+             not restart_file::decode(contents, rs_name, net.source_hash, st) )
+            return false;
+    }
+    else if ( not restart_file::read(rs_name, net.source_hash, st) ) return false;
 
-    if ( rs_file.is_open() )
+    auto &input = cell_inputs[cell_id];
+    if ( st.x.size() != input.inp_solution_vector.size() )
     {
-        std::getline ( rs_file, line_buffer );
-        boost::split ( line_tokens, line_buffer, boost::is_any_of ( " \t" ), boost::token_compress_on );
-        cell_inputs[cell_id].sim_start_time = boost::lexical_cast<double> ( line_tokens[0] );
-        std::getline ( rs_file, line_buffer );
-        boost::split ( line_tokens, line_buffer, boost::is_any_of ( "  \t" ), boost::token_compress_on );
-        for ( auto it = line_tokens.begin(); it != line_tokens.end(); ++it )
-        {
-            try{cell_inputs[cell_id].inp_vd.push_back ( boost::lexical_cast<double> ( *it ));}
-            catch(const std::exception& e){}
-        }
-        std::getline ( rs_file, line_buffer );
-        boost::split ( line_tokens, line_buffer, boost::is_any_of ( "  \t" ), boost::token_compress_on );
-        for ( auto it = line_tokens.begin(); it != line_tokens.end(); ++it )
-        {
-            try{cell_inputs[cell_id].inp_delSZ.push_back ( boost::lexical_cast<double> ( *it ));}
-            catch(const std::exception& e){}
-        }
-        std::getline ( rs_file, line_buffer );
-        boost::split ( line_tokens, line_buffer, boost::is_any_of ( "  \t" ), boost::token_compress_on );
-        for ( auto it = line_tokens.begin(); it != line_tokens.end(); ++it )
-        {
-            try{cell_inputs[cell_id].inp_solution_vector.push_back ( boost::lexical_cast<double> ( *it ));}
-            catch(const std::exception& e){}
-        }
+        PLOGW << "Restart file " << rs_name << " has " << st.x.size() << " values, expected "
+              << input.inp_solution_vector.size() << "; starting the cell over";
+        return false;
     }
+    // the output has to reach the restart point to be continued
+    size_t output_len = 0;
+#ifdef NUDUSTC_ENABLE_HDF5
+    if(h5_out) output_len = h5_out->cell_rows(cell_id);
+    else
+#endif
+    if(container) output_len = container->output_length(cell_id);
     else
     {
-        PLOGE << "Cannot open restart file " << nameRS+std::to_string ( cell_id ) + ".dat";
-        exit(1);
+        boost::system::error_code ec;
+        auto out_name = name+std::to_string ( cell_id ) + output_extension(nu_config.output_format);
+        output_len = boost::filesystem::file_size(out_name, ec);
+        if (ec) output_len = 0;
+    }
+    if ( nu_config.cell_output==1 && ( st.output_mark == 0 || output_len < st.output_mark ) )
+    {
+        PLOGW << "Output of cell " << cell_id << " does not reach its restart point; starting the cell over";
+        return false;
     }
+    input.inp_solution_vector = std::move(st.x);
+    input.inp_vd              = std::move(st.vd);
+    input.inp_delSZ           = std::move(st.delSZ);
+    input.resume_time         = st.time;
+    input.resume_output_mark  = st.output_mark;
+    return true;
 }
 
 // creates the simulation cells. this checks if there is an output file or restart file. If there are no restart or output file, create cell. If there's a restart file, load that data instead. If there's an output file and no restart, assume that cell has completed integration.
@@ -653,53 +898,194 @@ nuDust::create_simulation_cells()
 {
   PLOGI << "Creating cells with input data";
 
-  // distribute the cells
-  int cells_per_rank = cell_inputs.size() / par_size; // calculates how many cells each rank (process) should handle
-  int cell_rank_start_idx = par_rank * cells_per_rank; //calculates the starting index of the cells for the current rank, formerly known as 'cell_rank_disp'
-
-  int cell_end = (cell_rank_start_idx + cells_per_rank) < cell_inputs.size() ? cell_rank_start_idx + cells_per_rank : cell_inputs.size(); // This calculates the end index of the cells for the current rank, ensuring it doesn't exceed the total number of cells
-
-  //cell_end = cell_rank_start_idx + 10; // This is potentially problematic because it may exceed the actual number of cells available
-  // potential fix for the above line 
-  cell_end = std::min(cell_rank_start_idx + 10, static_cast<int>(cell_inputs.size()));
-
-  cells.reserve(cell_end - cell_rank_start_idx); // Reserves enough space in the cells vector to hold the cells assigned to this rank
-//  for (const auto& ic: cell_inputs) {
-//    cells_buf.emplace_back(&net, &nu_config, ic.first, initial_elements, ic.second);
-//  }
-
-  // Moves the iterator it to the starting index for the current rank
-  auto it = cell_inputs.begin();
-  for(auto r = 0; r < cell_rank_start_idx; r++)
+  if(!lazy_cells)
   {
-    it++;
+    cells.reserve(rank_cell_ids.size()); // Reserves enough space in the cells vector to hold the cells assigned to this rank
   }
-  //for(auto i = cell_rank_start_idx; i < cell_end; ++i)
-  for(auto i = cell_rank_start_idx; i < cell_end && it != cell_inputs.end(); ++i)
+
+  // with dynamic distribution, a rank's own file only knows its own
+  // cells. the ranks agree first: cells finished anywhere are skipped, and
+  // a cell with a restart is run by the rank that holds it
+  bool per_rank_files = dynamic_cells && container;
+#ifdef NUDUSTC_ENABLE_HDF5
+  per_rank_files = per_rank_files || (dynamic_cells && h5_out);
+#endif
+  std::vector<uint8_t> cell_flags;
+  if (per_rank_files) cell_flags = shared_cell_flags();
+
+  for(size_t k = 0; k < rank_cell_ids.size(); ++k)
   {
-        if (not std::filesystem::exists(name+std::to_string ( it->first ) + ".dat"))
+        auto cid = rank_cell_ids[k];
+        // a restart file means the cell was interrupted, even if part of its
+        // output is there. one that cannot be loaded is run from the start
+        bool has_restart = restart_exists(cid);
+        if (per_rank_files && not has_restart && cell_flags[k] != 0)
         {
-            if ( not std::filesystem::exists(nameRS+std::to_string ( it->first ) + ".dat"))
-            {
-                auto cid = it->first;
-                cells.emplace_back ( &net, &sputARR, &nu_config, it->first, initial_elements, cell_inputs[cid] );
-            }
-            else
+            cell_inputs.erase(cid);
+            continue;
+        }
+        if (has_restart) create_restart_cells(cid);
+        if (has_restart || not output_exists(cid))
+        {
+            cell_costs[cid] = estimate_cost(cid, cell_inputs[cid]);
+            if(lazy_cells)
             {
-                create_restart_cells(it->first);
+                // built by run(); keep the input until then
+                (per_rank_files && has_restart ? pinned_cell_ids : lazy_cell_ids).push_back(cid);
+                continue;
             }
+            cells.emplace_back ( &net, &sputARR, &nu_config, cid, initial_elements, std::move ( cell_inputs[cid] ) );
         }
-        it++;
+        // the cell has taken over what it needs from its input
+        cell_inputs.erase(cid);
   }
 
+  apply_recorded_timings();
+
+  if(lazy_cells)
+  {
+    PLOGI << "rank " << par_rank << " will build " << lazy_cell_ids.size() + pinned_cell_ids.size()
+          << " cells as they are run (" << pinned_cell_ids.size() << " resumed on this rank)\n";
+    return;
+  }
   PLOGI << "rank " << par_rank << " has " << cells.size() << " cells\n";
+  size_t cell_bytes = 0;
+  for(const auto &c : cells)
+  {
+    cell_bytes += c.memory_bytes();
+  }
+  PLOGI << "rank " << par_rank << " cells use " << cell_bytes << " bytes ("
+        << (cells.empty() ? 0 : cell_bytes / cells.size()) << " per cell)";
+}
+//*/
+
+// rough relative run time of a cell, used to start the expensive cells
+// first: the integrated time span, weighted by how dense the gas gets
+// (initial abundance times peak compression)
+double
+nuDust::estimate_cost(uint32_t cid, const cell_input& input) const
+{
+    auto from_env = [&](const auto &times, const auto &rho) {
+        double span = 3.14e7; // cells without a trajectory run for a year
+        double compression = 1.0;
+        if ( times.size() > 1 )
+        {
+            span = times[times.size()-1] - times[0];
+        }
+        if ( rho.size() > 0 && rho[0] > 0.0 )
+        {
+            compression = *std::max_element(rho.begin(), rho.end()) / rho[0];
+        }
+        double abund = std::accumulate(input.inp_init_abund.begin(), input.inp_init_abund.end(), 0.0);
+        return span * std::log1p(abund * compression);
+    };
+
+    if ( input.inp_times.empty() && !nu_config.input_bundle.empty() )
+    {
+        // lazy mode keeps the trajectory in the bundle until the cell is built
+        if ( auto c = bundle.find(cid) )
+        {
+            return from_env(bundle.column(*c, BCOL_TIMES), bundle.column(*c, BCOL_RHO));
+        }
+    }
+    else if ( input.inp_times.empty() && !env_index.blocks.empty() )
+    {
+        // and the text trajectory in the file; parse it once more here,
+        // only to size the cell
+        cell_input env;
+        env_index.load_cell ( cid, env );
+        return from_env(env.inp_times, env.inp_rho);
+    }
+    return from_env(input.inp_times, input.inp_rho);
+}
+
+// replace the estimates by the run times recorded by earlier runs. cells
+// without a record keep their estimate, scaled to seconds by the cells
+// that have both
+void
+nuDust::apply_recorded_timings()
+{
+    std::map<uint32_t, double> recorded;
+    auto prefix = std::filesystem::path(name).filename().string() + "timings_r";
+    auto dir = std::filesystem::path(name).parent_path();
+    if ( !std::filesystem::is_directory(dir) ) return;
+    for ( const auto &entry : std::filesystem::directory_iterator(dir) )
+    {
+        if ( entry.path().filename().string().rfind(prefix, 0) != 0 ) continue;
+        std::ifstream tfile ( entry.path() );
+        uint32_t cid;
+        double sec;
+        while ( tfile >> cid >> sec )
+        {
+            recorded[cid] = sec;
+        }
+    }
+    if ( recorded.empty() ) return;
 
-  // sarah added this b.s.
-  std::vector<int> cells_per_process(cell_inputs.size() / par_size);
+    double est_sum = 0.0, rec_sum = 0.0;
+    for ( const auto &kv : cell_costs )
+    {
+        auto it = recorded.find(kv.first);
+        if ( it == recorded.end() ) continue;
+        est_sum += kv.second;
+        rec_sum += it->second;
+    }
+    double scale = (est_sum > 0.0) ? rec_sum / est_sum : 1.0;
+    size_t n_recorded = 0;
+    for ( auto &kv : cell_costs )
+    {
+        auto it = recorded.find(kv.first);
+        if ( it != recorded.end() )
+        {
+            kv.second = it->second;
+            ++n_recorded;
+        }
+        else
+        {
+            kv.second *= scale;
+        }
+    }
+    PLOGI << "using recorded run times for " << n_recorded << " of " << cell_costs.size() << " cells";
+}
 
+// keep this rank's cell run times for ordering the next run
+void
+nuDust::write_cell_timings(const std::map<uint32_t, double>& seconds) const
+{
+    if ( seconds.empty() ) return;
+    std::ofstream tfile ( name + "timings_r" + std::to_string(par_rank) + ".dat" );
+    tfile.precision(6);
+    for ( const auto &kv : seconds )
+    {
+        tfile << kv.first << " " << kv.second << "\n";
+    }
+}
 
+// build one cell from its input, solve it and free it. the cell's output
+// is written by its observer before it goes out of scope. cell_inputs is
+// not resized here, so threads can take their own entries concurrently
+void
+nuDust::run_lazy_cell(uint32_t cid)
+{
+    cell_input input = std::move ( cell_inputs.at(cid) );
+    cell_inputs.at(cid) = cell_input();
+    if ( !nu_config.environment_file.empty() )
+    {
+        if ( !nu_config.input_bundle.empty() )
+        {
+            bundle.load_env ( cid, input );
+        }
+        else
+        {
+            env_index.load_cell ( cid, input );
+        }
+    }
+
+    cell c ( &net, &sputARR, &nu_config, cid, initial_elements, std::move ( input ) );
+    PLOGI << "running cell: " << cid << " (" << c.memory_bytes() << " bytes)";
+    c.solve();
+    PLOGI << "finished cell: " << cid;
 }
-//*/
 
 // begin calculations
 void
@@ -725,16 +1111,155 @@ nuDust::run()
         std::cout << "! Try again\n";
     }
 
-    #pragma omp parallel num_threads(2)
+    // one task per cell, most expensive first
+    std::vector<uint32_t> task_cids;
+    std::vector<std::function<void()>> tasks;
+    for (size_t i = 0; i < cells.size(); ++i)
     {
-        #pragma omp for nowait
-        for (auto i = 0; i < cells.size(); ++i)
-        {
+        task_cids.push_back(cells[i].cid);
+        tasks.emplace_back([this, i] {
             PLOGI << "running cell: " << cells[i].cid;
             cells[i].solve(); 
             PLOGI << "finished cell: " << cells[i].cid;
+        });
+    }
+    // lazy mode: at most one cell per thread is alive at any time
+    for (auto cid : lazy_cell_ids)
+    {
+        task_cids.push_back(cid);
+        tasks.emplace_back([this, cid] { run_lazy_cell(cid); });
+    }
+    size_t n_shared = tasks.size();
+    for (auto cid : pinned_cell_ids)
+    {
+        task_cids.push_back(cid);
+        tasks.emplace_back([this, cid] { run_lazy_cell(cid); });
+    }
+
+    std::vector<size_t> order(tasks.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return cell_costs[task_cids[a]] > cell_costs[task_cids[b]];
+    });
+
+    std::vector<double> elapsed(tasks.size(), -1.0);
+    // pinned cells run on this rank only, everything else is in ordered
+    std::vector<std::function<void()>> ordered, pinned;
+    for (auto i : order)
+    {
+        (i < n_shared ? ordered : pinned).emplace_back([&tasks, &elapsed, i] {
+            // after a stop signal, cells not yet started are left for the
+            // next run and a stopped cell's time is not a full cell's
+            if (stop_request::pending()) return;
+            auto start = std::chrono::steady_clock::now();
+            tasks[i]();
+            if (stop_request::pending()) return;
+            elapsed[i] = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        });
+    }
+
+    int n_threads = nu_config.n_threads;
+#ifdef NUDUSTC_ENABLE_MPI
+    if (n_threads <= 0)
+    {
+        // ranks on the same node share its cores
+        MPI_Comm node_comm;
+        int node_ranks;
+        MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, par_rank, MPI_INFO_NULL, &node_comm);
+        MPI_Comm_size(node_comm, &node_ranks);
+        MPI_Comm_free(&node_comm);
+        n_threads = work_pool::resolve_threads(n_threads, node_ranks);
+        PLOGI << "rank " << par_rank << " shares its node with " << node_ranks - 1 << " ranks, using "
+              << n_threads << " threads";
+    }
+    int thread_level;
+    MPI_Query_thread(&thread_level);
+    if (dynamic_cells && thread_level < MPI_THREAD_SERIALIZED && work_pool::resolve_threads(n_threads) > 1)
+    {
+        PLOGW << "MPI does not support calls from several threads, integrating cells on one thread";
+        n_threads = 1;
+    }
+#endif
+    work_pool pool(n_threads);
+
+    // summed over every cell of every rank as they integrate
+    std::unique_ptr<cell_reductions> reducer;
+    if (nu_config.reduce_n_times > 0)
+    {
+        std::vector<std::string> grain_names;
+        for (size_t g = 0; g < net.n_nucleation_reactions; ++g)
+        {
+            grain_names.push_back(net.reactions[g].prods[0]);
+        }
+        // the summary is only whole if every cell of every rank finishes here
+        unsigned long n_cells = rank_cell_ids.size();
+#ifdef NUDUSTC_ENABLE_MPI
+        if (!dynamic_cells && par_size > 1)
+        {
+            MPI_Allreduce(MPI_IN_PLACE, &n_cells, 1, MPI_UNSIGNED_LONG, MPI_SUM, MPI_COMM_WORLD);
         }
+#endif
+        reducer = std::make_unique<cell_reductions>(
+            cell_reductions::log_grid(nu_config.reduce_t_min, nu_config.reduce_t_max, nu_config.reduce_n_times),
+            grain_names, init_size_bins.empty() ? size_bins_init : init_size_bins, n_cells);
+        cell_reductions::active = reducer.get();
     }
 
+    // each observer has at most two snapshots queued
+    std::unique_ptr<io_thread> io;
+    if (nu_config.async_io == 1)
+    {
+        io = std::make_unique<io_thread>(2 * pool.size());
+        io_thread::active = io.get();
+    }
+
+    if (dynamic_cells)
+    {
+        // every rank holds the same ordered list; each worker thread takes
+        // the next batch from the shared counter until none are left
+#ifdef NUDUSTC_ENABLE_MPI
+        // all ranks must have built their list before anyone starts
+        // writing output, since the list skips cells with output files
+        MPI_Barrier(MPI_COMM_WORLD);
+#endif
+        if (!pinned.empty())
+        {
+            PLOGI << "resuming " << pinned.size() << " cells held by this rank on " << pool.size() << " threads";
+            pool.run(pinned);
+        }
+        task_counter counter(ordered.size(), nu_config.cell_batch);
+        std::vector<std::function<void()>> farm(pool.size(), [&] {
+            size_t begin, end;
+            while (not stop_request::pending() && counter.claim(begin, end))
+            {
+                for (auto i = begin; i < end; ++i) ordered[i]();
+            }
+        });
+        PLOGI << "taking " << ordered.size() << " shared cells in batches of " << nu_config.cell_batch << " on " << pool.size() << " threads";
+        pool.run(farm);
+    }
+    else
+    {
+        PLOGI << "running " << ordered.size() << " cells on " << pool.size() << " threads";
+        pool.run(ordered);
+    }
+
+    std::map<uint32_t, double> seconds;
+    for (size_t i = 0; i < tasks.size(); ++i)
+    {
+        if (elapsed[i] >= 0.0) seconds[task_cids[i]] = elapsed[i];
+    }
+    write_cell_timings(seconds);
+
+    io_thread::active = nullptr;
+    if (reducer)
+    {
+        reducer->write(name + "summary");
+        cell_reductions::active = nullptr;
+    }
+    if (stop_request::pending())
+    {
+        PLOGW << "stopped by signal " << stop_request::signal_number() << "; rerun to continue from the restart files";
+    }
     PLOGI << "Leaving main integration loop";
 }
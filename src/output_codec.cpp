@@ -0,0 +1,246 @@
+/*© 2023. Triad National Security, LLC. All rights reserved.
+This program was produced under U.S. Government contract 89233218CNA000001 for Los Alamos
+National Laboratory (LANL), which is operated by Triad National Security, LLC for the U.S.
+Department of Energy/National Nuclear Security Administration. All rights in the program are.
+reserved by Triad National Security, LLC, and the U.S. Department of Energy/National Nuclear
+Security Administration. The Government is granted for itself and others acting on its behalf a
+nonexclusive, paid-up, irrevocable worldwide license in this material to reproduce, prepare.
+derivative works, distribute copies to the public, perform publicly and display publicly, and to permit.
+others to do so.*/
+
+#include "output_codec.h"
+
+#include <plog/Log.h>
+
+#include <cstring>
+
+#ifdef NUDUSTC_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+namespace
+{
+void put_varint(std::string& out, uint64_t v)
+{
+  while (v >= 0x80)
+  {
+    out += static_cast<char>((v & 0x7f) | 0x80);
+    v >>= 7;
+  }
+  out += static_cast<char>(v);
+}
+
+bool get_varint(const unsigned char*& p, const unsigned char* end, uint64_t& v)
+{
+  v = 0;
+  for (int shift = 0; p < end && shift < 64; shift += 7)
+  {
+    uint64_t b = *p++;
+    v |= (b & 0x7f) << shift;
+    if (!(b & 0x80)) return true;
+  }
+  return false;
+}
+
+uint32_t swap32(uint32_t v) { return __builtin_bswap32(v); }
+
+void swap_doubles(double* p, size_t n)
+{
+  for (size_t i = 0; i < n; ++i)
+  {
+    uint64_t u;
+    std::memcpy(&u, p + i, sizeof(u));
+    u = __builtin_bswap64(u);
+    std::memcpy(p + i, &u, sizeof(u));
+  }
+}
+
+template<typename T>
+bool read_raw(std::ifstream& in, T* p, size_t n)
+{
+  return static_cast<bool>(in.read(reinterpret_cast<char*>(p), n * sizeof(T)));
+}
+} // namespace
+
+void
+output_codec::encode_block(const double* rows, size_t n_rows, size_t row_len, std::string& out)
+{
+  std::string enc;
+  enc.reserve(n_rows * row_len * 2);
+  std::vector<uint64_t> prev(row_len, 0), cur(row_len);
+  for (size_t r = 0; r < n_rows; ++r)
+  {
+    std::memcpy(cur.data(), rows + r * row_len, row_len * sizeof(double));
+    for (size_t i = 0; i < row_len;)
+    {
+      size_t zeros = 0, lits = 0;
+      while (i + zeros < row_len && cur[i + zeros] == prev[i + zeros]) ++zeros;
+      while (i + zeros + lits < row_len && cur[i + zeros + lits] != prev[i + zeros + lits]) ++lits;
+      put_varint(enc, zeros);
+      put_varint(enc, lits);
+      for (size_t k = i + zeros; k < i + zeros + lits; ++k)
+      {
+        uint64_t w = cur[k] ^ prev[k];
+        enc.append(reinterpret_cast<const char*>(&w), sizeof(w));
+      }
+      i += zeros + lits;
+    }
+    prev.swap(cur);
+  }
+
+  uint32_t head[4] = { static_cast<uint32_t>(n_rows), STORED, static_cast<uint32_t>(enc.size()),
+                       static_cast<uint32_t>(enc.size()) };
+  const char* stored = enc.data();
+#ifdef NUDUSTC_HAVE_ZLIB
+  std::string packed(compressBound(enc.size()), '\0');
+  uLongf packed_len = packed.size();
+  if (compress2(reinterpret_cast<Bytef*>(packed.data()), &packed_len,
+                reinterpret_cast<const Bytef*>(enc.data()), enc.size(), Z_DEFAULT_COMPRESSION) == Z_OK &&
+      packed_len < enc.size())
+  {
+    head[1] = DEFLATE;
+    head[3] = static_cast<uint32_t>(packed_len);
+    stored  = packed.data();
+  }
+#endif
+  out.append(reinterpret_cast<const char*>(head), sizeof(head));
+  out.append(stored, head[3]);
+}
+
+bool
+output_codec::decode_rows(const unsigned char* p, const unsigned char* end, size_t n_rows, size_t row_len,
+                          std::vector<uint64_t>& words)
+{
+  words.assign(n_rows * row_len, 0);
+  for (size_t r = 0; r < n_rows; ++r)
+  {
+    uint64_t* cur        = words.data() + r * row_len;
+    const uint64_t* prev = r ? cur - row_len : nullptr;
+    for (size_t i = 0; i < row_len;)
+    {
+      uint64_t zeros, lits;
+      if (!get_varint(p, end, zeros) || !get_varint(p, end, lits)) return false;
+      if (zeros + lits == 0 || i + zeros + lits > row_len) return false;
+      if (static_cast<size_t>(end - p) < lits * sizeof(uint64_t)) return false;
+      for (size_t k = i; k < i + zeros; ++k) cur[k] = prev ? prev[k] : 0;
+      for (size_t k = i + zeros; k < i + zeros + lits; ++k)
+      {
+        uint64_t w;
+        std::memcpy(&w, p, sizeof(w));
+        p += sizeof(w);
+        cur[k] = (prev ? prev[k] : 0) ^ w;
+      }
+      i += zeros + lits;
+    }
+  }
+  return p == end;
+}
+
+bool
+output_reader::open(const std::string& filename)
+{
+  in.open(filename, std::ios::binary);
+  char magic[4];
+  uint32_t head[7];
+  if (!read_raw(in, magic, 4) || !read_raw(in, head, 7))
+  {
+    PLOGE << filename << " is not a nuDust binary output file";
+    return false;
+  }
+  if (std::memcmp(magic, observer_header::MAGIC_COMPRESSED, 4) == 0) compressed = true;
+  else if (std::memcmp(magic, observer_header::MAGIC, 4) != 0)
+  {
+    PLOGE << filename << " is not a nuDust binary output file";
+    return false;
+  }
+  swapped = head[1] != observer_header::ORDER_PROBE;
+  if (swapped)
+  {
+    for (auto& h: head) h = swap32(h);
+  }
+  if (head[0] != observer_header::VERSION || head[1] != observer_header::ORDER_PROBE)
+  {
+    PLOGE << filename << " has unsupported version " << head[0];
+    return false;
+  }
+  header = observer_header { head[2], head[3], head[4], head[5], std::string(head[6], ' ') };
+  grain_sizes.resize(header.n_sizes);
+  initial.resize(header.n_values);
+  if (!read_raw(in, header.grain_names.data(), header.grain_names.size()) ||
+      !read_raw(in, grain_sizes.data(), grain_sizes.size()) || !read_raw(in, initial.data(), initial.size()))
+  {
+    PLOGE << filename << " is truncated";
+    return false;
+  }
+  if (swapped)
+  {
+    swap_doubles(grain_sizes.data(), grain_sizes.size());
+    swap_doubles(initial.data(), initial.size());
+  }
+  return true;
+}
+
+bool
+output_reader::read_block()
+{
+  uint32_t head[4];
+  if (!read_raw(in, head, 4)) return false;
+  if (swapped)
+  {
+    for (auto& h: head) h = swap32(h);
+  }
+  std::vector<unsigned char> stored(head[3]), encoded;
+  if (!read_raw(in, stored.data(), stored.size())) return false;
+  if (head[1] == output_codec::DEFLATE)
+  {
+#ifdef NUDUSTC_HAVE_ZLIB
+    encoded.resize(head[2]);
+    uLongf len = encoded.size();
+    if (uncompress(encoded.data(), &len, stored.data(), stored.size()) != Z_OK || len != head[2]) return false;
+#else
+    PLOGE << "compressed output needs a build with zlib";
+    return false;
+#endif
+  }
+  else encoded.swap(stored);
+
+  size_t row_len = header.n_values + 1;
+  std::vector<uint64_t> words;
+  if (!output_codec::decode_rows(encoded.data(), encoded.data() + encoded.size(), head[0], row_len, words))
+  {
+    PLOGE << "corrupt block in compressed output";
+    return false;
+  }
+  block.resize(words.size());
+  std::memcpy(block.data(), words.data(), words.size() * sizeof(uint64_t));
+  if (swapped) swap_doubles(block.data(), block.size());
+  block_rows = head[0];
+  block_pos  = 0;
+  return true;
+}
+
+bool
+output_reader::next(double& time, std::vector<double>& values)
+{
+  size_t n = header.n_values;
+  values.resize(n);
+  if (!compressed)
+  {
+    if (!read_raw(in, &time, 1) || !read_raw(in, values.data(), n)) return false;
+    if (swapped)
+    {
+      swap_doubles(&time, 1);
+      swap_doubles(values.data(), n);
+    }
+    return true;
+  }
+  while (block_pos == block_rows)
+  {
+    if (!read_block()) return false;
+  }
+  const double* row = block.data() + block_pos * (n + 1);
+  time = row[0];
+  std::copy(row + 1, row + 1 + n, values.begin());
+  ++block_pos;
+  return true;
+}
@@ -0,0 +1,226 @@
+/*© 2023. Triad National Security, LLC. All rights reserved.
+This program was produced under U.S. Government contract 89233218CNA000001 for Los Alamos
+National Laboratory (LANL), which is operated by Triad National Security, LLC for the U.S.
+Department of Energy/National Nuclear Security Administration. All rights in the program are.
+reserved by Triad National Security, LLC, and the U.S. Department of Energy/National Nuclear
+Security Administration. The Government is granted for itself and others acting on its behalf a
+nonexclusive, paid-up, irrevocable worldwide license in this material to reproduce, prepare.
+derivative works, distribute copies to the public, perform publicly and display publicly, and to permit.
+others to do so.*/
+
+
+#include "reductions.h"
+
+#include <plog/Log.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <numeric>
+
+#ifdef NUDUSTC_ENABLE_MPI
+#include <mpi.h>
+#endif
+
+cell_reductions* cell_reductions::active = nullptr;
+
+namespace
+{
+std::atomic<uint64_t> next_id { 1 };
+
+void write_values(std::ofstream& out, const double* v, size_t n)
+{
+  char num[32];
+  for (size_t i = 0; i < n; ++i)
+  {
+    std::snprintf(num, sizeof(num), " %.6e", v[i]);
+    out << num;
+  }
+  out << "\n";
+}
+
+template<typename T>
+void add_into(std::vector<T>& to, const std::vector<T>& from)
+{
+  for (size_t i = 0; i < to.size(); ++i) to[i] += from[i];
+}
+} // namespace
+
+cell_reductions::cell_reductions(std::vector<double> times, std::vector<std::string> grain_names,
+                                 std::vector<double> bin_sizes, size_t n_cells)
+  : id(next_id++), times(std::move(times)), grain_names(std::move(grain_names)), bin_sizes(std::move(bin_sizes)),
+    n_cells(n_cells)
+{
+}
+
+std::vector<double>
+cell_reductions::log_grid(double t_min, double t_max, int n)
+{
+  std::vector<double> grid(n);
+  double step = n > 1 ? std::log(t_max / t_min) / (n - 1) : 0.0;
+  for (int k = 0; k < n; ++k) grid[k] = t_min * std::exp(step * k);
+  if (n > 1) grid.back() = t_max;
+  return grid;
+}
+
+cell_reductions::accumulator&
+cell_reductions::local()
+{
+  thread_local std::shared_ptr<accumulator> acc;
+  thread_local uint64_t owner = 0;
+  if (owner != id)
+  {
+    acc = std::make_shared<accumulator>();
+    acc->mass.assign(times.size() * n_grains(), 0.0);
+    acc->sd_volume.assign(times.size() * n_grains() * n_bins(), 0.0);
+    acc->n_cells.assign(times.size(), 0.0);
+    owner = id;
+    std::lock_guard<std::mutex> g(lock);
+    accumulators.push_back(acc);
+  }
+  return *acc;
+}
+
+void
+cell_reductions::add(size_t k, const sample& s)
+{
+  auto& acc = local();
+  auto* mass = acc.mass.data() + k * n_grains();
+  for (size_t g = 0; g < n_grains(); ++g) mass[g] += s.mass[g];
+  auto* sd = acc.sd_volume.data() + k * n_grains() * n_bins();
+  for (size_t i = 0; i < n_grains() * n_bins(); ++i) sd[i] += s.sd_volume[i];
+  acc.n_cells[k] += 1.0;
+}
+
+void
+cell_reductions::add_final(uint32_t cid, const std::vector<double>& efficiency, bool resumed)
+{
+  auto& acc = local();
+  acc.cids.push_back(cid);
+  if (resumed) acc.n_resumed += 1.0;
+  acc.efficiency.insert(acc.efficiency.end(), efficiency.begin(), efficiency.end());
+}
+
+void
+cell_reductions::write(const std::string& stem)
+{
+  auto n_g = n_grains();
+  std::vector<double> mass(times.size() * n_g, 0.0);
+  std::vector<double> sd_volume(times.size() * n_g * n_bins(), 0.0);
+  std::vector<double> n_cells(times.size(), 0.0);
+  std::vector<double> n_resumed(1, 0.0);
+  std::vector<uint32_t> cids;
+  std::vector<double> efficiency;
+  {
+    std::lock_guard<std::mutex> g(lock);
+    for (const auto& acc: accumulators)
+    {
+      add_into(mass, acc->mass);
+      add_into(sd_volume, acc->sd_volume);
+      add_into(n_cells, acc->n_cells);
+      n_resumed[0] += acc->n_resumed;
+      cids.insert(cids.end(), acc->cids.begin(), acc->cids.end());
+      efficiency.insert(efficiency.end(), acc->efficiency.begin(), acc->efficiency.end());
+    }
+  }
+
+  int rank = 0, size = 1;
+#ifdef NUDUSTC_ENABLE_MPI
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &size);
+  if (size > 1)
+  {
+    for (auto* v: { &mass, &sd_volume, &n_cells, &n_resumed })
+    {
+      if (rank == 0) MPI_Reduce(MPI_IN_PLACE, v->data(), v->size(), MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+      else MPI_Reduce(v->data(), nullptr, v->size(), MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+    }
+    // the per cell table differs in length between ranks
+    int n = static_cast<int>(cids.size());
+    std::vector<int> counts(size), displs(size), eff_counts(size), eff_displs(size);
+    MPI_Gather(&n, 1, MPI_INT, counts.data(), 1, MPI_INT, 0, MPI_COMM_WORLD);
+    std::vector<uint32_t> all_cids;
+    std::vector<double> all_eff;
+    if (rank == 0)
+    {
+      for (int r = 0; r < size; ++r)
+      {
+        displs[r]     = r ? displs[r - 1] + counts[r - 1] : 0;
+        eff_counts[r] = counts[r] * static_cast<int>(n_g);
+        eff_displs[r] = displs[r] * static_cast<int>(n_g);
+      }
+      all_cids.resize(displs[size - 1] + counts[size - 1]);
+      all_eff.resize(all_cids.size() * n_g);
+    }
+    MPI_Gatherv(cids.data(), n, MPI_UINT32_T, all_cids.data(), counts.data(), displs.data(), MPI_UINT32_T, 0,
+                MPI_COMM_WORLD);
+    MPI_Gatherv(efficiency.data(), n * static_cast<int>(n_g), MPI_DOUBLE, all_eff.data(), eff_counts.data(),
+                eff_displs.data(), MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    cids       = std::move(all_cids);
+    efficiency = std::move(all_eff);
+  }
+#endif
+  if (rank != 0) return;
+
+  bool complete = cids.size() == this->n_cells && n_resumed[0] == 0.0;
+  auto filename = stem + (complete ? ".dat" : "_partial.dat");
+  std::ofstream out(filename);
+  if (!out)
+  {
+    PLOGE << "Cannot write reductions to " << filename;
+    return;
+  }
+  out << "# in-situ reductions of " << cids.size() << " finished cells on " << size << " rank(s)\n";
+  if (!complete)
+  {
+    out << "# partial: " << this->n_cells - (cids.size() - static_cast<size_t>(n_resumed[0])) << " of "
+        << this->n_cells << " cells were skipped, stopped or resumed and are missing from these sums\n";
+  }
+  out << "# grains:";
+  for (const auto& name: grain_names) out << " " << name;
+  out << "\n\n# dust mass: time (s), cells sampled, mass of each grain (g)\n";
+  for (size_t k = 0; k < times.size(); ++k)
+  {
+    char head[64];
+    std::snprintf(head, sizeof(head), "%.6e %.0f", times[k], n_cells[k]);
+    out << head;
+    write_values(out, mass.data() + k * n_g, n_g);
+  }
+
+  out << "\n# size distribution: time (s), grain, dust volume in each size bin (cm^3)\n# bin sizes (cm):";
+  write_values(out, bin_sizes.data(), n_bins());
+  for (size_t k = 0; k < times.size(); ++k)
+  {
+    for (size_t g = 0; g < n_g; ++g)
+    {
+      char head[64];
+      std::snprintf(head, sizeof(head), "%.6e %zu", times[k], g);
+      out << head;
+      write_values(out, sd_volume.data() + (k * n_g + g) * n_bins(), n_bins());
+    }
+  }
+
+  out << "\n# condensation efficiency: cell, fraction of the key species of each grain in dust at the end\n";
+  std::vector<size_t> order(cids.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return cids[a] < cids[b]; });
+  for (auto i: order)
+  {
+    out << cids[i];
+    write_values(out, efficiency.data() + i * n_g, n_g);
+  }
+  out.close();
+  if (complete)
+  {
+    // a summary left by an earlier, partial run is superseded
+    std::remove((stem + "_partial.dat").c_str());
+    PLOGI << "wrote in-situ reductions to " << filename;
+  }
+  else
+  {
+    PLOGW << "wrote partial in-situ reductions to " << filename << ": only " << cids.size() - n_resumed[0]
+          << " of " << this->n_cells << " cells were integrated whole in this run";
+  }
+}
@@ -0,0 +1,186 @@
+/*© 2023. Triad National Security, LLC. All rights reserved.
+This program was produced under U.S. Government contract 89233218CNA000001 for Los Alamos
+National Laboratory (LANL), which is operated by Triad National Security, LLC for the U.S.
+Department of Energy/National Nuclear Security Administration. All rights in the program are.
+reserved by Triad National Security, LLC, and the U.S. Department of Energy/National Nuclear
+Security Administration. The Government is granted for itself and others acting on its behalf a
+nonexclusive, paid-up, irrevocable worldwide license in this material to reproduce, prepare.
+derivative works, distribute copies to the public, perform publicly and display publicly, and to permit.
+others to do so.*/
+
+#include "restart_file.h"
+
+#include "utilities.h"
+
+#include <plog/Log.h>
+
+#include <boost/filesystem.hpp>
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace
+{
+constexpr char     MAGIC[4]    = { 'N', 'U', 'D', 'R' };
+constexpr uint32_t ORDER_PROBE = 0x01020304;
+
+// magic, version, probe, hash, mark, three counts
+constexpr size_t HEADER_BYTES = 4 + 2 * sizeof(uint32_t) + 5 * sizeof(uint64_t);
+
+template<typename T>
+void put(std::string& buf, const T& v)
+{
+  buf.append(reinterpret_cast<const char*>(&v), sizeof(T));
+}
+
+void put(std::string& buf, const std::vector<double>& v)
+{
+  buf.append(reinterpret_cast<const char*>(v.data()), v.size() * sizeof(double));
+}
+
+template<typename T>
+T get(const char*& p)
+{
+  T v;
+  std::memcpy(&v, p, sizeof(T));
+  p += sizeof(T);
+  return v;
+}
+
+void get(const char*& p, std::vector<double>& v, size_t n)
+{
+  v.resize(n);
+  std::memcpy(v.data(), p, n * sizeof(double));
+  p += n * sizeof(double);
+}
+
+bool write_all(int fd, const char* p, size_t n)
+{
+  while (n > 0)
+  {
+    auto w = ::write(fd, p, n);
+    if (w < 0) return false;
+    p += w;
+    n -= w;
+  }
+  return true;
+}
+} // namespace
+
+void
+restart_file::encode(uint64_t net_hash, double time, uint64_t output_mark, const std::vector<double>& vd,
+                     const std::vector<double>& delSZ, const std::vector<double>& x, std::string& buf)
+{
+  buf.clear();
+  buf.append(MAGIC, sizeof(MAGIC));
+  put(buf, VERSION);
+  put(buf, ORDER_PROBE);
+  put(buf, net_hash);
+  put(buf, output_mark);
+  put(buf, uint64_t(vd.size()));
+  put(buf, uint64_t(delSZ.size()));
+  put(buf, uint64_t(x.size()));
+  put(buf, time);
+  put(buf, vd);
+  put(buf, delSZ);
+  put(buf, x);
+  put(buf, utilities::fnv1a(buf.data(), buf.size()));
+}
+
+bool
+restart_file::write(const std::string& filename, uint64_t net_hash, double time, uint64_t output_mark,
+                    const std::vector<double>& vd, const std::vector<double>& delSZ,
+                    const std::vector<double>& x, std::string& buf)
+{
+  encode(net_hash, time, output_mark, vd, delSZ, x, buf);
+  auto tmpfile = filename + ".tmp";
+  int fd = ::open(tmpfile.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  bool ok = fd >= 0 && write_all(fd, buf.data(), buf.size()) && ::fsync(fd) == 0;
+  if (fd >= 0) ok = (::close(fd) == 0) && ok;
+  if (ok) ok = ::rename(tmpfile.c_str(), filename.c_str()) == 0;
+  if (!ok)
+  {
+    PLOGW << "cannot write restart file " << filename << ": " << std::strerror(errno);
+    ::unlink(tmpfile.c_str());
+  }
+  return ok;
+}
+
+bool
+restart_file::read(const std::string& filename, uint64_t net_hash, restart_state& state)
+{
+  boost::system::error_code ec;
+  auto size = boost::filesystem::file_size(filename, ec);
+  if (ec)
+  {
+    PLOGW << "restart file " << filename << " is missing";
+    return false;
+  }
+  std::string buf(size, '\0');
+  int fd = ::open(filename.c_str(), O_RDONLY);
+  bool ok = fd >= 0 && ::read(fd, buf.data(), size) == static_cast<ssize_t>(size);
+  if (fd >= 0) ::close(fd);
+  if (!ok)
+  {
+    PLOGW << "cannot read restart file " << filename;
+    return false;
+  }
+  return decode(buf, filename, net_hash, state);
+}
+
+bool
+restart_file::decode(const std::string& buf, const std::string& filename, uint64_t net_hash,
+                     restart_state& state)
+{
+  size_t size = buf.size();
+  if (size < HEADER_BYTES + 2 * sizeof(uint64_t))
+  {
+    PLOGW << "restart file " << filename << " is too short";
+    return false;
+  }
+  const char* p = buf.data();
+  if (std::memcmp(p, MAGIC, sizeof(MAGIC)) != 0)
+  {
+    PLOGW << filename << " is not a restart file";
+    return false;
+  }
+  p += sizeof(MAGIC);
+  auto version = get<uint32_t>(p);
+  auto probe   = get<uint32_t>(p);
+  if (version != VERSION || probe != ORDER_PROBE)
+  {
+    PLOGW << "restart file " << filename << " has version " << version << " or another byte order";
+    return false;
+  }
+  auto hash         = get<uint64_t>(p);
+  state.output_mark = get<uint64_t>(p);
+  auto n_vd         = get<uint64_t>(p);
+  auto n_delSZ      = get<uint64_t>(p);
+  auto n_x          = get<uint64_t>(p);
+  if (n_vd > size || n_delSZ > size || n_x > size ||
+      size != HEADER_BYTES + (1 + n_vd + n_delSZ + n_x) * sizeof(double) + sizeof(uint64_t))
+  {
+    PLOGW << "restart file " << filename << " has the wrong size";
+    return false;
+  }
+  const char* sum_at = buf.data() + size - sizeof(uint64_t);
+  uint64_t sum;
+  std::memcpy(&sum, sum_at, sizeof(sum));
+  if (sum != utilities::fnv1a(buf.data(), size - sizeof(uint64_t)))
+  {
+    PLOGW << "restart file " << filename << " fails its checksum";
+    return false;
+  }
+  if (hash != net_hash)
+  {
+    PLOGW << "restart file " << filename << " was written for another network";
+    return false;
+  }
+  state.time = get<double>(p);
+  get(p, state.vd, n_vd);
+  get(p, state.delSZ, n_delSZ);
+  get(p, state.x, n_x);
+  return true;
+}
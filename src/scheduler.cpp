@@ -0,0 +1,176 @@
+/*© 2023. Triad National Security, LLC. All rights reserved.
+This program was produced under U.S. Government contract 89233218CNA000001 for Los Alamos
+National Laboratory (LANL), which is operated by Triad National Security, LLC for the U.S.
+Department of Energy/National Nuclear Security Administration. All rights in the program are.
+reserved by Triad National Security, LLC, and the U.S. Department of Energy/National Nuclear
+Security Administration. The Government is granted for itself and others acting on its behalf a
+nonexclusive, paid-up, irrevocable worldwide license in this material to reproduce, prepare.
+derivative works, distribute copies to the public, perform publicly and display publicly, and to permit.
+others to do so.*/
+
+#include "scheduler.h"
+
+#include <algorithm>
+
+thread_local work_pool* work_pool::current_pool   = nullptr;
+thread_local size_t     work_pool::current_worker = 0;
+
+int
+work_pool::resolve_threads(int requested, int ranks_per_node)
+{
+  if (requested > 0) return requested;
+  return std::max(1, int(std::thread::hardware_concurrency()) / std::max(1, ranks_per_node));
+}
+
+work_pool::work_pool(int n_threads)
+{
+  n_threads = resolve_threads(n_threads);
+  for (int w = 0; w < n_threads; ++w)
+  {
+    queues.emplace_back(std::make_unique<worker_queue>());
+  }
+  for (int w = 0; w < n_threads; ++w)
+  {
+    threads.emplace_back(&work_pool::worker_loop, this, w);
+  }
+}
+
+work_pool::~work_pool()
+{
+  {
+    std::lock_guard<std::mutex> g(state_lock);
+    stopping = true;
+  }
+  work_ready.notify_all();
+  for (auto& t: threads) t.join();
+}
+
+bool
+work_pool::pop_own(size_t w, std::function<void()>& task)
+{
+  auto& q = *queues[w];
+  std::lock_guard<std::mutex> g(q.lock);
+  if (q.tasks.empty()) return false;
+  task = std::move(q.tasks.front());
+  q.tasks.pop_front();
+  return true;
+}
+
+// take the next task of another worker, its most expensive one left
+bool
+work_pool::steal(size_t w, std::function<void()>& task)
+{
+  for (size_t k = 1; k < queues.size(); ++k)
+  {
+    auto& q = *queues[(w + k) % queues.size()];
+    std::lock_guard<std::mutex> g(q.lock);
+    if (q.tasks.empty()) continue;
+    task = std::move(q.tasks.front());
+    q.tasks.pop_front();
+    return true;
+  }
+  return false;
+}
+
+void
+work_pool::worker_loop(size_t w)
+{
+  current_pool   = this;
+  current_worker = w;
+  uint64_t seen = 0;
+  for (;;)
+  {
+    std::function<void()> task;
+    if (pop_own(w, task) || steal(w, task))
+    {
+      task();
+      std::lock_guard<std::mutex> g(state_lock);
+      if (--n_pending == 0) work_done.notify_all();
+      continue;
+    }
+    // nothing left anywhere: sleep until the next batch
+    std::unique_lock<std::mutex> g(state_lock);
+    ++n_idle;
+    work_ready.wait(g, [&] { return stopping || generation != seen; });
+    --n_idle;
+    if (stopping) return;
+    seen = generation;
+  }
+}
+
+void
+work_pool::run(std::vector<std::function<void()>>& tasks)
+{
+  if (tasks.empty()) return;
+  {
+    std::lock_guard<std::mutex> g(state_lock);
+    n_pending += tasks.size();
+  }
+  for (size_t i = 0; i < tasks.size(); ++i)
+  {
+    auto& q = *queues[i % queues.size()];
+    std::lock_guard<std::mutex> g(q.lock);
+    q.tasks.push_back(std::move(tasks[i]));
+  }
+  {
+    std::lock_guard<std::mutex> g(state_lock);
+    ++generation;
+  }
+  work_ready.notify_all();
+
+  std::unique_lock<std::mutex> g(state_lock);
+  work_done.wait(g, [&] { return n_pending == 0; });
+}
+
+void
+work_pool::parallel_for(size_t n, const std::function<void(size_t)>& body)
+{
+  auto pool = current_pool;
+  size_t idle = pool ? pool->n_idle.load(std::memory_order_relaxed) : 0;
+  if (n < 2 || idle == 0)
+  {
+    for (size_t i = 0; i < n; ++i) body(i);
+    return;
+  }
+
+  // helpers that start after every index is claimed return without
+  // touching body, so the state outlives this call but body need not
+  struct loop_state
+  {
+    std::atomic<size_t> next { 0 };
+    std::atomic<size_t> done { 0 };
+    size_t n;
+    const std::function<void(size_t)>* body;
+  };
+  auto st  = std::make_shared<loop_state>();
+  st->n    = n;
+  st->body = &body;
+  auto run_indices = [st] {
+    size_t i;
+    while ((i = st->next.fetch_add(1)) < st->n)
+    {
+      (*st->body)(i);
+      st->done.fetch_add(1, std::memory_order_release);
+    }
+  };
+
+  size_t n_helpers = std::min(idle, n - 1);
+  {
+    std::lock_guard<std::mutex> g(pool->state_lock);
+    pool->n_pending += n_helpers;
+  }
+  {
+    auto& q = *pool->queues[current_worker];
+    std::lock_guard<std::mutex> g(q.lock);
+    for (size_t h = 0; h < n_helpers; ++h) q.tasks.push_front(run_indices);
+  }
+  {
+    std::lock_guard<std::mutex> g(pool->state_lock);
+    ++pool->generation;
+  }
+  pool->work_ready.notify_all();
+
+  run_indices();
+  // the remaining indices are already running on helpers
+  while (st->done.load(std::memory_order_acquire) < n) std::this_thread::yield();
+}
@@ -0,0 +1,42 @@
+/*© 2023. Triad National Security, LLC. All rights reserved.
+This program was produced under U.S. Government contract 89233218CNA000001 for Los Alamos
+National Laboratory (LANL), which is operated by Triad National Security, LLC for the U.S.
+Department of Energy/National Nuclear Security Administration. All rights in the program are.
+reserved by Triad National Security, LLC, and the U.S. Department of Energy/National Nuclear
+Security Administration. The Government is granted for itself and others acting on its behalf a
+nonexclusive, paid-up, irrevocable worldwide license in this material to reproduce, prepare.
+derivative works, distribute copies to the public, perform publicly and display publicly, and to permit.
+others to do so.*/
+
+
+#include "stop_request.h"
+
+#include <atomic>
+#include <signal.h>
+
+namespace
+{
+// written from the signal handler, so it has to be lock free
+std::atomic<int> received { 0 };
+static_assert(std::atomic<int>::is_always_lock_free, "stop flag must be usable in a signal handler");
+
+extern "C" void on_stop_signal(int sig) { received.store(sig, std::memory_order_relaxed); }
+} // namespace
+
+namespace stop_request
+{
+void install()
+{
+  struct sigaction act = {};
+  act.sa_handler = on_stop_signal;
+  sigemptyset(&act.sa_mask);
+  // interrupted writes of output and restart files are resumed
+  act.sa_flags = SA_RESTART;
+  sigaction(SIGTERM, &act, nullptr);
+  sigaction(SIGUSR1, &act, nullptr);
+}
+
+bool pending() { return received.load(std::memory_order_relaxed) != 0; }
+
+int signal_number() { return received.load(std::memory_order_relaxed); }
+} // namespace stop_request
@@ -0,0 +1,54 @@
+/*© 2023. Triad National Security, LLC. All rights reserved.
+This program was produced under U.S. Government contract 89233218CNA000001 for Los Alamos
+National Laboratory (LANL), which is operated by Triad National Security, LLC for the U.S.
+Department of Energy/National Nuclear Security Administration. All rights in the program are.
+reserved by Triad National Security, LLC, and the U.S. Department of Energy/National Nuclear
+Security Administration. The Government is granted for itself and others acting on its behalf a
+nonexclusive, paid-up, irrevocable worldwide license in this material to reproduce, prepare.
+derivative works, distribute copies to the public, perform publicly and display publicly, and to permit.
+others to do so.*/
+
+#include "task_farm.h"
+
+#include <algorithm>
+
+task_counter::task_counter(size_t n_tasks, size_t batch)
+  : n_tasks(n_tasks), batch(std::max<size_t>(1, batch))
+{
+#ifdef NUDUSTC_ENABLE_MPI
+  int rank;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Aint win_bytes = (rank == 0) ? sizeof(int64_t) : 0;
+  MPI_Win_allocate(win_bytes, sizeof(int64_t), MPI_INFO_NULL, MPI_COMM_WORLD, &next, &win);
+  if (rank == 0) *next = 0;
+  // nobody claims before rank 0 has zeroed the counter
+  MPI_Barrier(MPI_COMM_WORLD);
+  MPI_Win_lock_all(0, win);
+#endif
+}
+
+task_counter::~task_counter()
+{
+#ifdef NUDUSTC_ENABLE_MPI
+  MPI_Win_unlock_all(win);
+  MPI_Win_free(&win);
+#endif
+}
+
+bool
+task_counter::claim(size_t& begin, size_t& end)
+{
+  std::lock_guard<std::mutex> g(lock);
+#ifdef NUDUSTC_ENABLE_MPI
+  int64_t inc = batch, first = 0;
+  MPI_Fetch_and_op(&inc, &first, MPI_INT64_T, 0, 0, MPI_SUM, win);
+  MPI_Win_flush(0, win);
+  begin = static_cast<size_t>(first);
+#else
+  begin = next;
+  next += batch;
+#endif
+  if (begin >= n_tasks) return false;
+  end = std::min(begin + batch, n_tasks);
+  return true;
+}
@@ -0,0 +1,200 @@
+/*© 2023. Triad National Security, LLC. All rights reserved.
+This program was produced under U.S. Government contract 89233218CNA000001 for Los Alamos
+National Laboratory (LANL), which is operated by Triad National Security, LLC for the U.S.
+Department of Energy/National Nuclear Security Administration. All rights in the program are.
+reserved by Triad National Security, LLC, and the U.S. Department of Energy/National Nuclear
+Security Administration. The Government is granted for itself and others acting on its behalf a
+nonexclusive, paid-up, irrevocable worldwide license in this material to reproduce, prepare.
+derivative works, distribute copies to the public, perform publicly and display publicly, and to permit.
+others to do so.*/
+
+#include "text_table.h"
+
+#include <thread>
+#include <boost/filesystem.hpp>
+#include <plog/Log.h>
+
+namespace
+{
+
+// below this many bytes per thread the spawn costs more than the parse
+const size_t MIN_CHUNK_BYTES = 1 << 18;
+
+// the cell id at the start of the line [p, eol). q is left after it
+inline bool parse_row_id(const char*& q, const char* eol, uint32_t& cid)
+{
+  return text::parse_token(q, eol, cid) && (q == eol || text::is_blank(*q));
+}
+
+// parse the lines in [p, end) into chunk, keeping only the ids in keep
+void parse_chunk(const char* base, const char* p, const char* end, const std::vector<uint32_t>* keep, table_chunk& chunk)
+{
+  // rough reservation from the first line so the buffers grow rarely
+  const char* eol = text::end_of_line(p, end);
+  size_t est_rows = (eol > p) ? (end - p) / (eol - p + 1) + 1 : 0;
+  if (keep) est_rows = std::min(est_rows, keep->size());
+  chunk.ids.reserve(est_rows);
+  chunk.offsets.reserve(est_rows + 1);
+
+  for (; p < end; p = (eol < end) ? eol + 1 : end)
+  {
+    eol = text::end_of_line(p, end);
+    const char* q = text::skip_blank(p, eol);
+    if (q == eol) continue;
+
+    uint32_t cid;
+    if (!parse_row_id(q, eol, cid))
+    {
+      chunk.bad_byte = p - base;
+      return;
+    }
+    if (keep && !std::binary_search(keep->begin(), keep->end(), cid)) continue;
+    while ((q = text::skip_blank(q, eol)) < eol)
+    {
+      double v;
+      if (!text::parse_token(q, eol, v) || (q < eol && !text::is_blank(*q)))
+      {
+        chunk.bad_byte = p - base;
+        return;
+      }
+      chunk.vals.push_back(v);
+    }
+    chunk.ids.push_back(cid);
+    chunk.offsets.push_back(chunk.vals.size());
+  }
+}
+
+// only the ids of the lines in [p, end)
+void scan_chunk(const char* base, const char* p, const char* end, table_chunk& chunk)
+{
+  for (const char* eol; p < end; p = (eol < end) ? eol + 1 : end)
+  {
+    eol = text::end_of_line(p, end);
+    const char* q = text::skip_blank(p, eol);
+    if (q == eol) continue;
+
+    uint32_t cid;
+    if (!parse_row_id(q, eol, cid))
+    {
+      chunk.bad_byte = p - base;
+      return;
+    }
+    chunk.ids.push_back(cid);
+  }
+}
+
+// run fn(chunk index) for every chunk, on its own thread when there are several
+template<typename F>
+void for_each_chunk(size_t n_chunks, F fn)
+{
+  if (n_chunks == 1)
+  {
+    fn(0);
+    return;
+  }
+  std::vector<std::thread> workers;
+  workers.reserve(n_chunks);
+  for (size_t c = 0; c < n_chunks; ++c)
+  {
+    workers.emplace_back(fn, c);
+  }
+  for (auto& w: workers) w.join();
+}
+
+} // namespace
+
+std::vector<std::string>
+text::split_words(std::string_view line)
+{
+  std::vector<std::string> words;
+  const char* p   = line.data();
+  const char* end = p + line.size();
+  while ((p = skip_blank(p, end)) < end)
+  {
+    const char* w = p;
+    while (p < end && !is_blank(*p)) ++p;
+    words.emplace_back(w, p);
+  }
+  return words;
+}
+
+bool
+text_table::open(const std::string& filename)
+{
+  namespace bip = boost::interprocess;
+
+  data = nullptr;
+  size = pos = 0;
+  if (!boost::filesystem::exists(filename)) return false;
+  if (boost::filesystem::file_size(filename) == 0) return true;
+
+  file   = bip::file_mapping(filename.c_str(), bip::read_only);
+  region = bip::mapped_region(file, bip::read_only);
+  data   = static_cast<const char*>(region.get_address());
+  size   = region.get_size();
+  return true;
+}
+
+// the next line of the header, without its line ending
+std::string_view
+text_table::next_line()
+{
+  if (pos >= size) return {};
+  const char* p   = data + pos;
+  const char* eol = text::end_of_line(p, data + size);
+  pos = eol - data + (eol < data + size ? 1 : 0);
+  return std::string_view(p, eol - p);
+}
+
+// line aligned boundaries splitting the rows after the header into chunks
+std::vector<const char*>
+text_table::chunk_bounds(int n_threads) const
+{
+  size_t n_bytes = size - pos;
+  if (n_threads < 1) n_threads = std::max(1u, std::thread::hardware_concurrency());
+  size_t n_chunks = std::max<size_t>(1, std::min<size_t>(n_threads, n_bytes / MIN_CHUNK_BYTES));
+
+  const char* end = data + size;
+  std::vector<const char*> bounds { data + pos };
+  for (size_t c = 1; c < n_chunks; ++c)
+  {
+    const char* b = std::max(bounds.back(), data + pos + c * n_bytes / n_chunks);
+    b = text::end_of_line(b, end);
+    bounds.push_back(b < end ? b + 1 : end);
+  }
+  bounds.push_back(end);
+  return bounds;
+}
+
+// the cell id of every row after the header, in file order. exits on a
+// malformed id
+std::vector<uint32_t>
+text_table::scan_ids(int n_threads) const
+{
+  auto bounds = chunk_bounds(n_threads);
+  std::vector<table_chunk> chunks(bounds.size() - 1);
+  for_each_chunk(chunks.size(), [&](size_t c) { scan_chunk(data, bounds[c], bounds[c + 1], chunks[c]); });
+
+  std::vector<uint32_t> ids;
+  for (const auto& chunk: chunks)
+  {
+    if (chunk.bad_byte != std::string::npos)
+    {
+      PLOGE << "bad cell id at byte " << chunk.bad_byte;
+      exit(1);
+    }
+    ids.insert(ids.end(), chunk.ids.begin(), chunk.ids.end());
+  }
+  return ids;
+}
+
+// parse the rows after the header, or only those whose id is in keep
+// (sorted ascending). chunks come back in file order
+std::vector<table_chunk>
+text_table::parse_rows(int n_threads, const std::vector<uint32_t>* keep) const
+{
+  auto bounds = chunk_bounds(n_threads);
+  std::vector<table_chunk> chunks(bounds.size() - 1);
+  for_each_chunk(chunks.size(), [&](size_t c) { parse_chunk(data, bounds[c], bounds[c + 1], keep, chunks[c]); });
+  return chunks;
+}
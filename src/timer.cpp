@@ -0,0 +1,199 @@
+/*© 2023. Triad National Security, LLC. All rights reserved.
+This program was produced under U.S. Government contract 89233218CNA000001 for Los Alamos
+National Laboratory (LANL), which is operated by Triad National Security, LLC for the U.S.
+Department of Energy/National Nuclear Security Administration. All rights in the program are.
+reserved by Triad National Security, LLC, and the U.S. Department of Energy/National Nuclear
+Security Administration. The Government is granted for itself and others acting on its behalf a
+nonexclusive, paid-up, irrevocable worldwide license in this material to reproduce, prepare.
+derivative works, distribute copies to the public, perform publicly and display publicly, and to permit.
+others to do so.*/
+
+#include "timer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <map>
+#include <mutex>
+#include <sstream>
+
+#ifdef NUDUSTC_ENABLE_MPI
+#include <mpi.h>
+#endif
+
+namespace
+{
+
+struct thread_table
+{
+  std::vector<timing_stats> stats; // indexed by timer id
+};
+
+std::mutex                                 registry_lock;
+std::vector<std::string>                   names;
+std::vector<std::shared_ptr<thread_table>> tables;
+
+thread_table& local_table()
+{
+  thread_local std::shared_ptr<thread_table> table;
+  if (!table)
+  {
+    table = std::make_shared<thread_table>();
+    std::lock_guard<std::mutex> g(registry_lock);
+    tables.push_back(table);
+  }
+  return *table;
+}
+
+#ifdef NUDUSTC_ENABLE_MPI
+// name, count, total, max and the non-empty buckets of each timer, one
+// timer per line, so tables of other ranks can be merged by name
+std::string serialize(const std::map<std::string, timing_stats>& merged)
+{
+  std::ostringstream os;
+  for (const auto& [name, s]: merged)
+  {
+    os << name << '\t' << s.count << ' ' << s.total_ns << ' ' << s.max_ns;
+    for (size_t b = 0; b < timing_stats::N_BUCKETS; ++b)
+    {
+      if (s.buckets[b]) os << ' ' << b << ' ' << s.buckets[b];
+    }
+    os << '\n';
+  }
+  return os.str();
+}
+
+void deserialize(const std::string& text, std::map<std::string, timing_stats>& merged)
+{
+  std::istringstream is(text);
+  std::string line;
+  while (std::getline(is, line))
+  {
+    auto tab = line.find('\t');
+    if (tab == std::string::npos) continue;
+    timing_stats s;
+    std::istringstream ls(line.substr(tab + 1));
+    ls >> s.count >> s.total_ns >> s.max_ns;
+    size_t b;
+    uint64_t n;
+    while (ls >> b >> n)
+    {
+      if (b < timing_stats::N_BUCKETS) s.buckets[b] = n;
+    }
+    merged[line.substr(0, tab)].merge(s);
+  }
+}
+#endif
+
+} // namespace
+
+void
+timing_stats::merge(const timing_stats& o)
+{
+  count    += o.count;
+  total_ns += o.total_ns;
+  max_ns    = std::max(max_ns, o.max_ns);
+  for (size_t b = 0; b < N_BUCKETS; ++b) buckets[b] += o.buckets[b];
+}
+
+// middle of the bucket holding the q-th duration
+double
+timing_stats::percentile(double q) const
+{
+  if (count == 0) return 0.0;
+  uint64_t rank = static_cast<uint64_t>(q * (count - 1)) + 1;
+  uint64_t seen = 0;
+  for (size_t b = 0; b < N_BUCKETS; ++b)
+  {
+    seen += buckets[b];
+    if (seen >= rank)
+    {
+      double mid = std::ldexp(1.0 + (b % 4 + 0.5) / 4.0, static_cast<int>(b / 4));
+      return std::min<double>(mid, max_ns);
+    }
+  }
+  return max_ns;
+}
+
+size_t
+timing_registry::id(const std::string& name)
+{
+  std::lock_guard<std::mutex> g(registry_lock);
+  auto it = std::find(names.begin(), names.end(), name);
+  if (it != names.end()) return it - names.begin();
+  names.push_back(name);
+  return names.size() - 1;
+}
+
+void
+timing_registry::record(size_t id, uint64_t ns)
+{
+  auto& stats = local_table().stats;
+  if (stats.size() <= id) stats.resize(id + 1);
+  stats[id].add(ns);
+}
+
+void
+timing_registry::report(std::ostream& os)
+{
+  std::map<std::string, timing_stats> merged;
+  {
+    std::lock_guard<std::mutex> g(registry_lock);
+    for (const auto& t: tables)
+    {
+      for (size_t i = 0; i < t->stats.size(); ++i)
+      {
+        if (t->stats[i].count) merged[names[i]].merge(t->stats[i]);
+      }
+    }
+  }
+
+  int rank = 0, size = 1;
+#ifdef NUDUSTC_ENABLE_MPI
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &size);
+  if (size > 1)
+  {
+    auto text = serialize(merged);
+    int len   = static_cast<int>(text.size());
+    std::vector<int> lens(size), displs(size);
+    MPI_Gather(&len, 1, MPI_INT, lens.data(), 1, MPI_INT, 0, MPI_COMM_WORLD);
+    std::string all;
+    if (rank == 0)
+    {
+      for (int r = 1; r < size; ++r) displs[r] = displs[r - 1] + lens[r - 1];
+      all.resize(displs[size - 1] + lens[size - 1]);
+    }
+    MPI_Gatherv(text.data(), len, MPI_CHAR, all.data(), lens.data(), displs.data(), MPI_CHAR, 0, MPI_COMM_WORLD);
+    if (rank == 0)
+    {
+      merged.clear();
+      deserialize(all, merged);
+    }
+  }
+#endif
+  if (rank != 0 || merged.empty()) return;
+
+  // slowest in total first
+  std::vector<std::pair<std::string, timing_stats>> rows(merged.begin(), merged.end());
+  std::stable_sort(rows.begin(), rows.end(),
+                   [](const auto& a, const auto& b) { return a.second.total_ns > b.second.total_ns; });
+
+  os << "timings over " << size << " rank(s), percentiles in us\n";
+  os << std::left << std::setw(24) << "fn" << std::right
+     << std::setw(14) << "calls" << std::setw(14) << "total s" << std::setw(12) << "mean"
+     << std::setw(12) << "p50" << std::setw(12) << "p90" << std::setw(12) << "p99"
+     << std::setw(12) << "max" << "\n";
+  os << std::fixed;
+  for (const auto& [name, s]: rows)
+  {
+    os << std::left << std::setw(24) << name << std::right
+       << std::setw(14) << s.count
+       << std::setw(14) << std::setprecision(3) << s.total_ns * 1e-9
+       << std::setw(12) << std::setprecision(2) << s.total_ns * 1e-3 / s.count
+       << std::setw(12) << s.percentile(0.50) * 1e-3
+       << std::setw(12) << s.percentile(0.90) * 1e-3
+       << std::setw(12) << s.percentile(0.99) * 1e-3
+       << std::setw(12) << s.max_ns * 1e-3 << "\n";
+  }
+}
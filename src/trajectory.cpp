@@ -0,0 +1,233 @@
+/*© 2023. Triad National Security, LLC. All rights reserved.
+This program was produced under U.S. Government contract 89233218CNA000001 for Los Alamos
+National Laboratory (LANL), which is operated by Triad National Security, LLC for the U.S.
+Department of Energy/National Nuclear Security Administration. All rights in the program are.
+reserved by Triad National Security, LLC, and the U.S. Department of Energy/National Nuclear
+Security Administration. The Government is granted for itself and others acting on its behalf a
+nonexclusive, paid-up, irrevocable worldwide license in this material to reproduce, prepare.
+derivative works, distribute copies to the public, perform publicly and display publicly, and to permit.
+others to do so.*/
+
+#include "trajectory.h"
+
+#include "cell.h"
+#include "text_table.h"
+
+#include <algorithm>
+#include <boost/filesystem.hpp>
+#include <plog/Log.h>
+
+namespace
+{
+
+using text::is_blank;
+using text::skip_blank;
+using text::end_of_line;
+using text::parse_token;
+
+// a cell line: cid temp vol rho press velo x_cm
+struct env_line
+{
+  uint32_t cid;
+  double vals[6];
+};
+
+inline bool parse_env_line(const char* p, const char* end, env_line& l)
+{
+  if (!parse_token(p, end, l.cid)) return false;
+  for (auto& v: l.vals)
+    if (!parse_token(p, end, v)) return false;
+  return true;
+}
+
+inline bool parse_cid(const char* p, const char* end, uint32_t& cid)
+{
+  return parse_token(p, end, cid);
+}
+
+void push_env_line(const env_line& l, double time, cell_input& input)
+{
+  input.inp_times.push_back(time);
+  input.inp_temp.push_back(l.vals[0]);
+  input.inp_volumes.push_back(l.vals[1]);
+  input.inp_rho.push_back(l.vals[2]);
+  input.inp_pressure.push_back(l.vals[3]);
+  input.inp_velo.push_back(l.vals[4]);
+  input.inp_x_cm.push_back(l.vals[5]);
+}
+
+bool line_before(const trajectory_index::cell_line& a, const trajectory_index::cell_line& b)
+{
+  return a.cid != b.cid ? a.cid < b.cid : a.offset < b.offset;
+}
+
+} // namespace
+
+// map the file and record where every time block starts and ends
+bool
+trajectory_index::open(const std::string& filename)
+{
+  namespace bip = boost::interprocess;
+
+  blocks.clear();
+  unsorted_lines.clear();
+  if (!boost::filesystem::exists(filename) || boost::filesystem::file_size(filename) == 0)
+  {
+    return false;
+  }
+  file   = bip::file_mapping(filename.c_str(), bip::read_only);
+  region = bip::mapped_region(file, bip::read_only);
+  data   = static_cast<const char*>(region.get_address());
+  size   = region.get_size();
+
+  const char* end = data + size;
+  uint32_t prev_cid = 0;
+  // lines of the current block, kept if the block turns out unsorted
+  std::vector<cell_line> block_lines;
+  auto close_block = [&] {
+    if (!blocks.empty() && !blocks.back().sorted)
+      unsorted_lines.insert(unsorted_lines.end(), block_lines.begin(), block_lines.end());
+    block_lines.clear();
+  };
+  for (const char* p = data; p < end;)
+  {
+    const char* eol = end_of_line(p, end);
+    const char* tok = skip_blank(p, eol);
+    if (tok == eol)
+    {
+      // blank lines are skipped, but break the binary search in a block
+      if (!blocks.empty()) blocks.back().sorted = false;
+    }
+    else
+    {
+      const char* tok_end = tok;
+      while (tok_end < eol && !is_blank(*tok_end)) ++tok_end;
+      if (skip_blank(tok_end, eol) == eol)
+      {
+        // a single token is the time of the next block
+        trajectory_block b;
+        const char* q = tok;
+        if (!parse_token(q, tok_end, b.time))
+        {
+          PLOGE << "bad time in environment file at byte " << (tok - data);
+          exit(1);
+        }
+        b.begin  = eol - data + (eol < end ? 1 : 0);
+        b.end    = b.begin;
+        b.sorted = true;
+        close_block();
+        blocks.push_back(b);
+        prev_cid = 0;
+      }
+      else if (!blocks.empty())
+      {
+        uint32_t cid;
+        if (!parse_cid(tok, eol, cid))
+        {
+          PLOGE << "bad cell id in environment file at byte " << (tok - data);
+          exit(1);
+        }
+        auto& b = blocks.back();
+        if (b.end != b.begin && cid < prev_cid) b.sorted = false;
+        prev_cid = cid;
+        block_lines.push_back({ cid, size_t(tok - data) });
+        b.end    = eol - data + (eol < end ? 1 : 0);
+      }
+    }
+    p = eol < end ? eol + 1 : end;
+  }
+  close_block();
+  std::sort(unsorted_lines.begin(), unsorted_lines.end(), line_before);
+  PLOGI << "indexed environment file " << filename << ": " << blocks.size() << " times";
+  return true;
+}
+
+// offset of the first line in the block whose cell id is >= cid
+size_t
+trajectory_index::lower_line(const trajectory_block& b, uint32_t cid) const
+{
+  size_t lo = b.begin, hi = b.end;
+  while (lo < hi)
+  {
+    size_t mid = lo + (hi - lo) / 2;
+    size_t ls  = mid;
+    while (ls > lo && data[ls - 1] != '\n') --ls;
+    const char* eol = end_of_line(data + ls, data + b.end);
+    uint32_t line_cid;
+    if (!parse_cid(data + ls, eol, line_cid))
+    {
+      PLOGE << "bad cell id in environment file at byte " << ls;
+      exit(1);
+    }
+    if (line_cid < cid)
+      lo = eol - data + 1;
+    else
+      hi = ls;
+  }
+  return std::min(lo, b.end);
+}
+
+// parse the trajectory of the given cells (sorted ascending) into inputs
+void
+trajectory_index::load_cells(const std::vector<uint32_t>& cids, std::map<uint32_t, cell_input>& inputs) const
+{
+  scan(cids, [&](uint32_t cid) -> cell_input& { return inputs[cid]; });
+}
+
+// parse the trajectory of a single cell
+void
+trajectory_index::load_cell(uint32_t cid, cell_input& input) const
+{
+  scan({ cid }, [&](uint32_t) -> cell_input& { return input; });
+}
+
+// walk the blocks and hand every line of a requested cell to sink.
+// sorted blocks are binary searched, the lines of unsorted blocks are
+// looked up in unsorted_lines
+void
+trajectory_index::scan(const std::vector<uint32_t>& cids, const std::function<cell_input&(uint32_t)>& sink) const
+{
+  if (cids.empty()) return;
+  for (const auto& b: blocks)
+  {
+    if (!b.sorted)
+    {
+      for (const auto& cid: cids)
+      {
+        auto it = std::lower_bound(unsorted_lines.begin(), unsorted_lines.end(), cell_line{ cid, b.begin },
+                                   line_before);
+        for (; it != unsorted_lines.end() && it->cid == cid && it->offset < b.end; ++it)
+        {
+          const char* p   = data + it->offset;
+          const char* eol = end_of_line(p, data + b.end);
+          env_line l;
+          if (!parse_env_line(p, eol, l))
+          {
+            PLOGE << "bad line in environment file at byte " << it->offset;
+            exit(1);
+          }
+          push_env_line(l, b.time, sink(cid));
+        }
+      }
+      continue;
+    }
+    size_t start = lower_line(b, cids.front());
+    const char* block_end = data + b.end;
+    for (const char* p = data + start; p < block_end;)
+    {
+      const char* eol = end_of_line(p, block_end);
+      if (skip_blank(p, eol) != eol)
+      {
+        env_line l;
+        if (!parse_env_line(p, eol, l))
+        {
+          PLOGE << "bad line in environment file at byte " << (p - data);
+          exit(1);
+        }
+        if (l.cid > cids.back()) break;
+        if (std::binary_search(cids.begin(), cids.end(), l.cid)) push_env_line(l, b.time, sink(l.cid));
+      }
+      p = eol < block_end ? eol + 1 : block_end;
+    }
+  }
+}